@@ -0,0 +1,28 @@
+# Regenerates `token_kind.def` from its `.pdef` template whenever the template
+# or the generator scripts change, since the symbol DFA is derived from the
+# token list. The other `.def` files are checked in and refreshed by hand with
+# `tools/gen.py`: `unicode_tables.def` depends on the host Python's
+# `unicodedata`, so regenerating it during a build could silently change it.
+# This is skipped when no Python interpreter is available.
+find_package(Python3 COMPONENTS Interpreter)
+
+if(Python3_Interpreter_FOUND)
+  set(DARK_TOOLS_DIR ${PROJECT_SOURCE_DIR}/tools)
+  file(GLOB DARK_GENERATOR_SCRIPTS CONFIGURE_DEPENDS
+    ${DARK_TOOLS_DIR}/*.py
+    ${DARK_TOOLS_DIR}/generator/*.py)
+
+  set(DARK_TOKEN_KIND_TEMPLATE ${PROJECT_SOURCE_DIR}/include/lexer/token_kind.pdef)
+  set(DARK_TOKEN_KIND_OUTPUT ${PROJECT_SOURCE_DIR}/include/lexer/token_kind.def)
+  add_custom_command(
+    OUTPUT ${DARK_TOKEN_KIND_OUTPUT}
+    COMMAND Python3::Interpreter ${DARK_TOOLS_DIR}/gen.py -i ${DARK_TOKEN_KIND_TEMPLATE} --force
+    DEPENDS ${DARK_TOKEN_KIND_TEMPLATE} ${DARK_GENERATOR_SCRIPTS}
+    COMMENT "Generating include/lexer/token_kind.def"
+    VERBATIM)
+
+  add_custom_target(dark_generated_files DEPENDS ${DARK_TOKEN_KIND_OUTPUT})
+else()
+  message(STATUS "Python3 not found; token_kind.def will not be refreshed")
+  add_custom_target(dark_generated_files)
+endif()
@@ -11,7 +11,14 @@
 namespace dark {
 
     struct IdBase: public Printable<IdBase> {
+        // Wide ids lift the 2GiB limit on sources and token counts at the cost of
+        // doubling the size of every id.
+    #ifdef DARK_WIDE_SOURCE_OFFSETS
+        using inner_type = std::int64_t;
+    #else
         using inner_type = std::int32_t;
+    #endif
+        using unsigned_type = std::make_unsigned_t<inner_type>;
         static constexpr inner_type invalid {-1};
         
         constexpr IdBase() noexcept = default;
@@ -41,8 +48,8 @@ namespace dark {
             is_valid() ? (os << index) : (os << "<invalid>");
         }
 
-        constexpr auto as_unsigned() const noexcept -> unsigned {
-            return static_cast<unsigned>(index);
+        constexpr auto as_unsigned() const noexcept -> unsigned_type {
+            return static_cast<unsigned_type>(index);
         }
 
         constexpr operator size_t() const noexcept {
@@ -80,15 +87,15 @@ namespace dark {
     template <detail::IsIndexBase Index>
     struct IndexMapInfo {
         static inline auto get_empty_key() -> Index {
-            return Index(llvm::DenseMapInfo<int32_t>::getEmptyKey());
+            return Index(llvm::DenseMapInfo<IdBase::inner_type>::getEmptyKey());
         }
 
         static inline auto get_tombstone_key() -> Index {
-            return Index(llvm::DenseMapInfo<int32_t>::getTombstoneKey());
+            return Index(llvm::DenseMapInfo<IdBase::inner_type>::getTombstoneKey());
         }
 
         static auto get_hash_value(const Index& val) -> unsigned {
-            return llvm::DenseMapInfo<int32_t>::getHashValue(val.index);
+            return llvm::DenseMapInfo<IdBase::inner_type>::getHashValue(val.index);
         }
 
         static auto is_equal(const Index& lhs, const Index& rhs) -> bool {
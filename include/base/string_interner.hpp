@@ -0,0 +1,345 @@
+#ifndef __DARK_BASE_STRING_INTERNER_HPP__
+#define __DARK_BASE_STRING_INTERNER_HPP__
+
+#include "common/assert.hpp"
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/xxhash.h>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <utility>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+namespace dark {
+
+    // Maps strings to dense indices and can be shared between threads.
+    //
+    // The map is split into shards picked by the top bits of the string's hash.
+    // Each shard is a Swiss-style open-addressing table: a byte of control per
+    // slot holds a 7-bit tag of the hash, sixteen of them are matched at once,
+    // and the slot keeps the full hash next to the index so that a string is
+    // only compared when its whole hash agrees. Control bytes and slots are
+    // atomic, so looking up a string that is already interned takes no lock;
+    // only inserting takes the shard's mutex.
+    //
+    // A string is a `{data, length}` entry. Copied strings keep their bytes in
+    // their shard's arena of fixed-size blocks, which never move; borrowed
+    // ones point at the caller's bytes, so neither kind needs an allocation of
+    // its own.
+    //
+    // Indices come from a single counter, so they are dense but, with several
+    // writers, depend on the order in which the inserts win their locks.
+    struct StringInterner {
+        static constexpr auto npos = ~std::size_t{};
+
+        StringInterner()
+            : m_state(std::make_unique<State>())
+        {
+        }
+
+        StringInterner(StringInterner const&) = delete;
+        StringInterner(StringInterner&&) noexcept = default;
+        StringInterner& operator=(StringInterner const&) = delete;
+        StringInterner& operator=(StringInterner&&) noexcept = default;
+        ~StringInterner() = default;
+
+        [[nodiscard]] static auto hash(std::string_view value) noexcept -> std::uint64_t {
+            return llvm::xxHash64(llvm::StringRef(value.data(), value.size()));
+        }
+
+        // Returns the index of `value`, adding it if needed. When `copy` is
+        // false the caller guarantees that `value` outlives the interner.
+        auto intern(std::string_view value, std::uint64_t hash, bool copy) -> std::size_t {
+            auto& shard = get_shard(hash);
+            if (auto index = shard.find(*this, value, hash); index != npos) return index;
+
+            auto lock = std::lock_guard(shard.mutex);
+            if (auto index = shard.find(*this, value, hash); index != npos) return index;
+
+            auto entry = Entry{ .data = value.data(), .length = value.size() };
+            if (copy) {
+                auto* bytes = value.empty() ? nullptr : shard.allocate(value.size());
+                if (bytes != nullptr) std::memcpy(bytes, value.data(), value.size());
+                entry.data = bytes;
+            }
+
+            auto const index = m_state->next_index.fetch_add(1, std::memory_order_relaxed);
+            get_entry_slot(index) = entry;
+            shard.insert(index, hash);
+            return index;
+        }
+
+        [[nodiscard]] auto find(std::string_view value, std::uint64_t hash) const noexcept -> std::size_t {
+            return get_shard(hash).find(*this, value, hash);
+        }
+
+        // `index` must come from `intern` or `find`.
+        [[nodiscard]] auto get(std::size_t index) const noexcept -> std::string_view {
+            dark_assert(index < size(), "invalid string index");
+            auto const [segment, offset] = locate(index);
+            auto const entry = m_state->segments[segment].load(std::memory_order_acquire)[offset];
+            return { entry.data, entry.length };
+        }
+
+        // Exact once no insert is in flight.
+        [[nodiscard]] auto size() const noexcept -> std::size_t {
+            return m_state->next_index.load(std::memory_order_acquire);
+        }
+
+        // Sizes the tables for `size` strings so that early inserts do not
+        // rehash. Must not race with inserts.
+        auto reserve(std::size_t size) -> void {
+            for (auto& shard: m_state->shards) {
+                shard.grow_to(size / shard_count + 1);
+            }
+        }
+
+        // Must not race with any other member.
+        auto clear() -> void {
+            m_state = std::make_unique<State>();
+        }
+
+    private:
+        static constexpr auto shard_bits = 5u;
+        static constexpr auto shard_count = std::size_t{ 1 } << shard_bits;
+
+        // A group is sixteen control bytes, kept in two words so that readers
+        // can load them atomically. A zero byte marks an empty slot and a full
+        // one has its top bit set; nothing is ever erased.
+        static constexpr auto group_size = std::size_t{ 16 };
+
+        // Entries are stored in segments that double in size and never move, so
+        // readers can index them while a writer appends.
+        static constexpr auto first_segment_bits = 10u;
+        static constexpr auto segment_count = 32u;
+
+        // A shard's arena is a list of fixed-size blocks and a string's bytes
+        // never straddle two of them. Strings larger than a quarter of a block
+        // get an allocation of their own rather than wasting the rest of the
+        // current block.
+        static constexpr auto block_size = std::size_t{ 1 } << 20;
+        static constexpr auto max_packed_size = block_size / 4;
+
+        // Entries point straight at the bytes, so the arena can grow without
+        // bound and neither kind of string needs more than the entry.
+        struct Entry {
+            char const* data;
+            std::size_t length;
+        };
+
+        static_assert(sizeof(Entry) == 16, "Entries are meant to stay compact");
+
+        struct Slot {
+            std::atomic<std::uint64_t> hash;
+            std::atomic<std::size_t> index;
+        };
+
+        struct Table {
+            explicit Table(std::size_t group_count)
+                : group_mask(group_count - 1)
+                , control(std::make_unique<std::atomic<std::uint64_t>[]>(group_count * 2))
+                , slots(std::make_unique<Slot[]>(group_count * group_size))
+            {
+            }
+
+            [[nodiscard]] auto capacity() const noexcept -> std::size_t {
+                return (group_mask + 1) * group_size;
+            }
+
+            struct Match {
+                std::uint32_t tags;
+                std::uint32_t empty;
+            };
+
+            // Returns one bit per slot of `group` whose control byte is `tag` and
+            // one per empty slot.
+            [[nodiscard]] auto match(std::size_t group, std::uint8_t tag) const noexcept -> Match {
+                auto const low = control[group * 2].load(std::memory_order_acquire);
+                auto const high = control[group * 2 + 1].load(std::memory_order_acquire);
+
+            #if defined(__SSE2__)
+                auto const bytes = _mm_set_epi64x(static_cast<long long>(high), static_cast<long long>(low));
+                return {
+                    .tags = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(static_cast<char>(tag))))),
+                    .empty = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_setzero_si128())))
+                };
+            #else
+                auto result = Match{ .tags = 0, .empty = 0 };
+                for (auto i = 0u; i < group_size; ++i) {
+                    auto const byte = static_cast<std::uint8_t>((i < 8 ? low : high) >> ((i % 8) * 8));
+                    result.tags |= static_cast<std::uint32_t>(byte == tag) << i;
+                    result.empty |= static_cast<std::uint32_t>(byte == 0) << i;
+                }
+                return result;
+            #endif
+            }
+
+            std::size_t group_mask;
+            std::unique_ptr<std::atomic<std::uint64_t>[]> control;
+            std::unique_ptr<Slot[]> slots;
+        };
+
+        // The first group comes from the low bits of the hash and the tag from
+        // bits just below the ones that pick the shard.
+        [[nodiscard]] static constexpr auto get_tag(std::uint64_t hash) noexcept -> std::uint8_t {
+            return static_cast<std::uint8_t>(0x80 | ((hash >> (57 - shard_bits)) & 0x7F));
+        }
+
+        struct Shard {
+            Shard() {
+                table.store(make_table(1), std::memory_order_relaxed);
+            }
+
+            [[nodiscard]] auto find(StringInterner const& interner, std::string_view value, std::uint64_t hash) const noexcept -> std::size_t {
+                auto const* current = table.load(std::memory_order_acquire);
+                auto const tag = get_tag(hash);
+                auto group = hash & current->group_mask;
+                for (auto stride = std::size_t{ 1 };; group = (group + stride++) & current->group_mask) {
+                    auto const [tags, empty] = current->match(group, tag);
+                    for (auto bits = tags; bits != 0; bits &= bits - 1) {
+                        auto const& slot = current->slots[group * group_size + static_cast<std::size_t>(std::countr_zero(bits))];
+                        if (slot.hash.load(std::memory_order_relaxed) != hash) continue;
+                        auto const index = slot.index.load(std::memory_order_relaxed);
+                        if (interner.get(index) == value) return index;
+                    }
+                    if (empty != 0) return npos;
+                }
+            }
+
+            // Callers hold `mutex`.
+            auto insert(std::size_t index, std::uint64_t hash) -> void {
+                grow_to(size + 1);
+                place(*table.load(std::memory_order_relaxed), index, hash);
+                ++size;
+            }
+
+            // Keeps the load under 7/8. Slots carry their hash, so nothing is
+            // rehashed. Readers may still be probing the old table, so it is
+            // retired instead of freed.
+            auto grow_to(std::size_t count) -> void {
+                auto const* current = table.load(std::memory_order_relaxed);
+                auto capacity = current->capacity();
+                if (count * 8 <= capacity * 7) return;
+                while (count * 8 > capacity * 7) capacity *= 2;
+
+                auto* next = make_table(capacity / group_size);
+                for (auto i = std::size_t{}; i <= current->group_mask; ++i) {
+                    for (auto bits = current->match(i, 0).empty ^ 0xFFFFu; bits != 0; bits &= bits - 1) {
+                        auto const& slot = current->slots[i * group_size + static_cast<std::size_t>(std::countr_zero(bits))];
+                        place(*next, slot.index.load(std::memory_order_relaxed), slot.hash.load(std::memory_order_relaxed));
+                    }
+                }
+                table.store(next, std::memory_order_release);
+            }
+
+            auto make_table(std::size_t group_count) -> Table* {
+                return tables.emplace_back(std::make_unique<Table>(group_count)).get();
+            }
+
+            // The slot is filled before its control byte is published, so a reader
+            // that sees the tag also sees the slot.
+            static auto place(Table& target, std::size_t index, std::uint64_t hash) noexcept -> void {
+                auto const tag = get_tag(hash);
+                auto group = hash & target.group_mask;
+                for (auto stride = std::size_t{ 1 };; group = (group + stride++) & target.group_mask) {
+                    auto const empty = target.match(group, tag).empty;
+                    if (empty == 0) continue;
+
+                    auto const position = static_cast<std::size_t>(std::countr_zero(empty));
+                    auto& slot = target.slots[group * group_size + position];
+                    slot.hash.store(hash, std::memory_order_relaxed);
+                    slot.index.store(index, std::memory_order_relaxed);
+                    target.control[group * 2 + position / 8].fetch_or(std::uint64_t{ tag } << ((position % 8) * 8), std::memory_order_release);
+                    return;
+                }
+            }
+
+            // Returns `byte_count` fresh bytes that stay put for the interner's
+            // lifetime. Callers hold `mutex`.
+            auto allocate(std::size_t byte_count) -> char* {
+                if (byte_count > max_packed_size) {
+                    return storage.emplace_back(std::make_unique_for_overwrite<char[]>(byte_count)).get();
+                }
+                if (byte_count > block_size - used) {
+                    block = storage.emplace_back(std::make_unique_for_overwrite<char[]>(block_size)).get();
+                    used = 0;
+                }
+                auto* bytes = block + used;
+                used += byte_count;
+                return bytes;
+            }
+
+            std::mutex mutex;
+            std::atomic<Table*> table;
+            std::size_t size{};
+            char* block{};
+            std::size_t used{ block_size };
+            llvm::SmallVector<std::unique_ptr<char[]>, 0> storage;
+            llvm::SmallVector<std::unique_ptr<Table>, 4> tables;
+        };
+
+        struct State {
+            State() {
+                for (auto& segment: segments) segment.store(nullptr, std::memory_order_relaxed);
+            }
+
+            ~State() {
+                for (auto& segment: segments) delete[] segment.load(std::memory_order_relaxed);
+            }
+
+            State(State const&) = delete;
+            State(State&&) = delete;
+            State& operator=(State const&) = delete;
+            State& operator=(State&&) = delete;
+
+            std::array<Shard, shard_count> shards;
+            std::array<std::atomic<Entry*>, segment_count> segments;
+            std::mutex segment_mutex;
+            std::atomic<std::size_t> next_index{};
+        };
+
+        [[nodiscard]] static constexpr auto locate(std::size_t index) noexcept -> std::pair<std::size_t, std::size_t> {
+            auto const bucket = (index >> first_segment_bits) + 1;
+            auto const segment = static_cast<std::size_t>(std::bit_width(bucket)) - 1;
+            auto const first = ((std::size_t{ 1 } << segment) - 1) << first_segment_bits;
+            return { segment, index - first };
+        }
+
+        [[nodiscard]] static constexpr auto get_shard_index(std::uint64_t hash) noexcept -> std::size_t {
+            return static_cast<std::size_t>(hash >> (64 - shard_bits));
+        }
+
+        [[nodiscard]] auto get_shard(std::uint64_t hash) const noexcept -> Shard& {
+            return m_state->shards[get_shard_index(hash)];
+        }
+
+        auto get_entry_slot(std::size_t index) -> Entry& {
+            auto const [segment, offset] = locate(index);
+            auto& pointer = m_state->segments[segment];
+            auto* entries = pointer.load(std::memory_order_acquire);
+            if (entries == nullptr) {
+                auto lock = std::lock_guard(m_state->segment_mutex);
+                entries = pointer.load(std::memory_order_relaxed);
+                if (entries == nullptr) {
+                    entries = new Entry[std::size_t{ 1 } << (first_segment_bits + segment)];
+                    pointer.store(entries, std::memory_order_release);
+                }
+            }
+            return entries[offset];
+        }
+
+        std::unique_ptr<State> m_state;
+    };
+
+} // namespace dark
+
+#endif // __DARK_BASE_STRING_INTERNER_HPP__
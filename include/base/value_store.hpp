@@ -2,37 +2,122 @@
 #define __DARK_BASE_VALUE_STORE_HPP__
 
 #include "base/index_base.hpp"
+#include "base/string_interner.hpp"
 #include "base/yaml.hpp"
 #include "common/assert.hpp"
 #include "common/cow.hpp"
 #include "common/ostream.hpp"
+#include "common/real_conversion.hpp"
 #include <llvm/ADT/APInt.h>
-#include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/Support/raw_ostream.h>
 #include <llvm/Support/YAMLParser.h>
 #include <llvm/ADT/APFloat.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/xxhash.h>
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstdint>
+#include <limits>
+#include <optional>
 #include <string>
 #include <string_view>
 #include <type_traits>
 
 namespace dark {
 
+    // Non-negative integers below `1 << embedded_bits` are encoded in the id
+    // itself, using the indices below `invalid`, and never reach the store.
     struct IntId: public IdBase, public Printable<IntId> {
         using value_type = llvm::APInt;
         static const IntId invalid;
+        static constexpr auto embedded_bits = 30u;
 
         using IdBase::IdBase;
 
+        [[nodiscard]] static constexpr auto make_embedded(std::uint64_t value) noexcept -> IntId {
+            dark_assert(value < (std::uint64_t{ 1 } << embedded_bits), "value is too large to embed");
+            return IntId(static_cast<inner_type>(IdBase::invalid - 1 - static_cast<inner_type>(value)));
+        }
+
+        [[nodiscard]] constexpr auto is_embedded() const noexcept -> bool {
+            return index < IdBase::invalid;
+        }
+
+        [[nodiscard]] constexpr auto get_embedded_value() const noexcept -> std::uint64_t {
+            dark_assert(is_embedded(), "id does not embed a value");
+            return static_cast<std::uint64_t>(IdBase::invalid - 1 - index);
+        }
+
         auto print(llvm::raw_ostream& os) const -> void {
             os << "int";
-            IdBase::print(os);
+            if (is_embedded()) {
+                os << "=" << get_embedded_value();
+            } else {
+                IdBase::print(os);
+            }
         }
     };
 
     constexpr IntId IntId::invalid = IntId{};
     static_assert(detail::ImplementsPrint<IntId>, "IntId must implement print method");
+    static_assert(IntId::embedded_bits < sizeof(IdBase::inner_type) * 8 - 1, "embedded values must fit below IdBase::invalid");
+
+    // What `ValueStore<IntId>::get` returns: either an embedded integer or a
+    // reference to a stored one, which is valid until the store is modified.
+    struct IntView: public Printable<IntView> {
+        constexpr explicit IntView(std::uint64_t value) noexcept
+            : m_embedded(value)
+        {
+        }
+
+        constexpr explicit IntView(llvm::APInt const& value) noexcept
+            : m_stored(&value)
+        {
+        }
+
+        [[nodiscard]] constexpr auto is_embedded() const noexcept -> bool {
+            return m_stored == nullptr;
+        }
+
+        [[nodiscard]] auto get_active_bits() const noexcept -> unsigned {
+            if (is_embedded()) return static_cast<unsigned>(std::bit_width(m_embedded));
+            return m_stored->getActiveBits();
+        }
+
+        // Embedded values come back as the signed, non-negative `APInt` the
+        // lexer would have built for them.
+        [[nodiscard]] auto to_apint() const -> llvm::APInt {
+            if (!is_embedded()) return *m_stored;
+            auto const width = std::max(static_cast<unsigned>(std::bit_width(m_embedded)), 1u) + 2;
+            return llvm::APInt(width, m_embedded);
+        }
+
+        auto print(llvm::raw_ostream& os, bool is_signed) const -> void {
+            if (is_embedded()) {
+                os << m_embedded;
+            } else {
+                m_stored->print(os, is_signed);
+            }
+        }
+
+        auto print(llvm::raw_ostream& os) const -> void {
+            print(os, /*is_signed=*/false);
+        }
+
+        friend auto operator==(IntView const& lhs, std::uint64_t rhs) noexcept -> bool {
+            if (lhs.is_embedded()) return lhs.m_embedded == rhs;
+            return *lhs.m_stored == rhs;
+        }
+
+    private:
+        std::uint64_t m_embedded{};
+        llvm::APInt const* m_stored{ nullptr };
+    };
 
     struct Real: public Printable<Real> {
         auto print(llvm::raw_ostream& os) const -> void {
@@ -45,6 +130,8 @@ namespace dark {
         bool is_decimal;
     };
 
+    // Reals that are exactly a `double` are stored as one and use the indices
+    // below `invalid`, numbered separately from those kept as a `Real`.
     struct RealId: public IdBase, public Printable<RealId> {
         // mantissa, exponent; this is here to conform to the 'IsValueStoreValue' concept
         using value_type = Real;
@@ -52,14 +139,83 @@ namespace dark {
 
         using IdBase::IdBase;
 
+        [[nodiscard]] static constexpr auto make_double(std::size_t index) noexcept -> RealId {
+            dark_assert(index < static_cast<std::size_t>(std::numeric_limits<inner_type>::max()), "overflow detected");
+            return RealId(static_cast<inner_type>(IdBase::invalid - 1 - static_cast<inner_type>(index)));
+        }
+
+        [[nodiscard]] constexpr auto is_double() const noexcept -> bool {
+            return index < IdBase::invalid;
+        }
+
+        [[nodiscard]] constexpr auto get_double_index() const noexcept -> std::size_t {
+            dark_assert(is_double(), "id does not refer to a double");
+            return static_cast<std::size_t>(IdBase::invalid - 1 - index);
+        }
+
         auto print(llvm::raw_ostream& os) const -> void {
-            os << "real";
-            IdBase::print(os);
+            if (is_double()) {
+                os << "double" << get_double_index();
+            } else {
+                os << "real";
+                IdBase::print(os);
+            }
         }
     };
 
     static_assert(detail::ImplementsPrint<RealId>, "FloatId must implement print method");
 
+    // What `ValueStore<RealId>::get` returns: either a `double` or a reference
+    // to a stored `Real`, which is valid until the store is modified.
+    struct RealView: public Printable<RealView> {
+        constexpr explicit RealView(double value) noexcept
+            : m_double(value)
+        {
+        }
+
+        constexpr explicit RealView(Real const& value) noexcept
+            : m_stored(&value)
+        {
+        }
+
+        [[nodiscard]] constexpr auto is_double() const noexcept -> bool {
+            return m_stored == nullptr;
+        }
+
+        [[nodiscard]] constexpr auto get_double() const noexcept -> double {
+            dark_assert(is_double(), "real is not stored as a double");
+            return m_double;
+        }
+
+        [[nodiscard]] constexpr auto get_real() const noexcept -> Real const& {
+            dark_assert(!is_double(), "real is stored as a double");
+            return *m_stored;
+        }
+
+        // The nearest `double`, which for a stored `Real` may be rounded or
+        // infinite.
+        [[nodiscard]] auto to_double() const -> double {
+            if (is_double()) return m_double;
+            return m_stored->is_decimal
+                ? decimal_to_double(m_stored->mantissa, m_stored->exponent)
+                : binary_to_double(m_stored->mantissa, m_stored->exponent);
+        }
+
+        auto print(llvm::raw_ostream& os) const -> void {
+            if (!is_double()) {
+                m_stored->print(os);
+                return;
+            }
+            auto text = llvm::SmallString<32>();
+            llvm::APFloat(m_double).toString(text);
+            os << text;
+        }
+
+    private:
+        double m_double{};
+        Real const* m_stored{ nullptr };
+    };
+
 
     struct FloatId: public IdBase, public Printable<FloatId> {
         using value_type = llvm::APFloat;
@@ -128,6 +284,89 @@ namespace dark {
         concept IsValueStoreValue = IsIndexBase<T> && requires {
             typename T::value_type;
         };
+
+        [[nodiscard]] inline auto hash_apint(llvm::APInt const& value) noexcept -> std::uint64_t {
+            auto const bytes = llvm::ArrayRef<std::uint8_t>(
+                reinterpret_cast<std::uint8_t const*>(value.getRawData()),
+                value.getNumWords() * sizeof(std::uint64_t)
+            );
+            return llvm::xxHash64(bytes) ^ (value.getBitWidth() * 0x9E3779B97F4A7C15ull);
+        }
+
+        // `APInt::operator==` asserts that the widths agree.
+        [[nodiscard]] inline auto is_same_apint(llvm::APInt const& lhs, llvm::APInt const& rhs) noexcept -> bool {
+            return lhs.getBitWidth() == rhs.getBitWidth() && lhs == rhs;
+        }
+
+        // Value types with a `ContentKey` are deduplicated by their store.
+        template <typename T>
+        struct ContentKey;
+
+        template <>
+        struct ContentKey<Real> {
+            static auto hash(Real const& value) noexcept -> std::uint64_t {
+                return std::rotl(hash_apint(value.mantissa), 21) ^ hash_apint(value.exponent) ^ value.is_decimal;
+            }
+
+            static auto equal(Real const& lhs, Real const& rhs) noexcept -> bool {
+                return lhs.is_decimal == rhs.is_decimal
+                    && is_same_apint(lhs.mantissa, rhs.mantissa)
+                    && is_same_apint(lhs.exponent, rhs.exponent);
+            }
+        };
+
+        template <typename T>
+        concept IsDeduplicated = requires (T const& value) {
+            { ContentKey<T>::hash(value) } -> std::same_as<std::uint64_t>;
+            { ContentKey<T>::equal(value, value) } -> std::same_as<bool>;
+        };
+
+        // Maps content hashes to ids; ids that share a hash are chained through
+        // `m_next`, which is indexed by id.
+        struct ContentIndex {
+            template <typename EqualFn>
+            [[nodiscard]] auto find(std::uint64_t hash, EqualFn&& is_equal) const -> IdBase::inner_type {
+                auto const it = m_heads.find(get_key(hash));
+                if (it == m_heads.end()) return IdBase::invalid;
+                for (auto id = it->second; id != IdBase::invalid; id = m_next[static_cast<std::size_t>(id)]) {
+                    if (is_equal(id)) return id;
+                }
+                return IdBase::invalid;
+            }
+
+            // Ids must be inserted in order.
+            auto insert(std::uint64_t hash, IdBase::inner_type id) -> void {
+                dark_assert(static_cast<std::size_t>(id) == m_next.size(), "ids must be inserted in order");
+                auto& head = m_heads.try_emplace(get_key(hash), IdBase::invalid).first->second;
+                m_next.push_back(head);
+                head = id;
+            }
+
+            auto reserve(std::size_t size) -> void {
+                m_heads.reserve(static_cast<unsigned>(size));
+                m_next.reserve(size);
+            }
+
+            auto clear() -> void {
+                m_heads.clear();
+                m_next.clear();
+            }
+
+        private:
+            // The top bit is dropped so that no hash collides with the map's
+            // empty and tombstone keys.
+            [[nodiscard]] static constexpr auto get_key(std::uint64_t hash) noexcept -> std::uint64_t {
+                return hash >> 1;
+            }
+
+            llvm::DenseMap<std::uint64_t, IdBase::inner_type> m_heads;
+            llvm::SmallVector<IdBase::inner_type, 0> m_next;
+        };
+
+        struct NoContentIndex {
+            auto reserve(std::size_t) -> void {}
+            auto clear() -> void {}
+        };
     }
 
     template <detail::IsValueStoreValue IdT>
@@ -139,16 +378,42 @@ namespace dark {
         >
     {
         using value_type = typename IdT::value_type;
-
-        auto add(value_type value) -> IdT {
-            auto id = IdT{static_cast<IdT::inner_type>(m_values.size())};
-            dark_assert(id >= 0, "overflow detected");
-            m_values.push_back(value);
-            return id;
+        static constexpr auto is_deduplicated = detail::IsDeduplicated<value_type>;
+
+        // Stores of values with a `detail::ContentKey` return the existing id
+        // for a value they already hold.
+        auto add(value_type const& value) -> IdT {
+            if constexpr (is_deduplicated) {
+                auto const hash = detail::ContentKey<value_type>::hash(value);
+                if (auto id = find(value, hash); id.is_valid()) return id;
+                return insert(value_type(value), hash);
+            } else {
+                return insert(value_type(value));
+            }
+        }
+
+        auto add(value_type&& value) -> IdT {
+            if constexpr (is_deduplicated) {
+                auto const hash = detail::ContentKey<value_type>::hash(value);
+                if (auto id = find(value, hash); id.is_valid()) return id;
+                return insert(std::move(value), hash);
+            } else {
+                return insert(std::move(value));
+            }
+        }
+
+        template <typename... Args>
+        auto emplace(Args&&... args) -> IdT {
+            if constexpr (is_deduplicated) {
+                return add(value_type(std::forward<Args>(args)...));
+            } else {
+                m_values.emplace_back(std::forward<Args>(args)...);
+                return make_id(m_values.size() - 1);
+            }
         }
 
         auto add_default() -> IdT {
-            return add(value_type{});
+            return emplace();
         }
 
         constexpr auto get(IdT id) noexcept -> value_type& {
@@ -171,10 +436,12 @@ namespace dark {
 
         auto reserve(std::size_t size) -> void {
             m_values.reserve(size);
+            m_index.reserve(size);
         }
 
         auto clear() -> void {
             m_values.clear();
+            m_index.clear();
         }
 
         auto output_yaml() const -> yaml::OutputMapping {
@@ -186,68 +453,283 @@ namespace dark {
             }};
         }
     private:
+        static auto make_id(std::size_t index) -> IdT {
+            auto id = IdT{static_cast<IdT::inner_type>(index)};
+            dark_assert(id.index >= 0, "overflow detected");
+            return id;
+        }
+
+        auto find(value_type const& value, std::uint64_t hash) const -> IdT {
+            return IdT(m_index.find(hash, [&](IdBase::inner_type id) {
+                return detail::ContentKey<value_type>::equal(m_values[static_cast<std::size_t>(id)], value);
+            }));
+        }
+
+        auto insert(value_type&& value) -> IdT {
+            auto id = make_id(m_values.size());
+            m_values.push_back(std::move(value));
+            return id;
+        }
+
+        auto insert(value_type&& value, std::uint64_t hash) -> IdT {
+            auto id = insert(std::move(value));
+            m_index.insert(hash, id.index);
+            return id;
+        }
+
         llvm::SmallVector<value_type, 0> m_values;
+        [[no_unique_address]] std::conditional_t<is_deduplicated, detail::ContentIndex, detail::NoContentIndex> m_index;
     };
 
+    // Only integers that do not fit in an `IntId` are stored, once each; `size`
+    // and `array_ref` cover just those.
     template<>
-    struct ValueStore<StringId>: public yaml::Printable<ValueStore<StringId>> {
-        auto add(CowString value) -> StringId {
-            auto id = StringId{m_values.size()};
-            dark_assert(id.index >= 0, "overflow detected");
+    struct ValueStore<IntId>: public yaml::Printable<ValueStore<IntId>> {
+        using value_type = llvm::APInt;
 
-            auto [it, inserted] = m_map.insert({ value.borrow(), id });
-            if (inserted) m_values.push_back(value);
-            return it->second;
+        auto add(llvm::APInt const& value) -> IntId {
+            if (is_embeddable(value)) return IntId::make_embedded(value.getZExtValue());
+            auto const hash = detail::hash_apint(value);
+            if (auto id = find(value, hash); id.is_valid()) return id;
+            return insert(llvm::APInt(value), hash);
         }
 
-        auto add_borrowed(std::string_view value) -> StringId {
-            return add(CowString::make_borrowed(value));
+        auto add(llvm::APInt&& value) -> IntId {
+            if (is_embeddable(value)) return IntId::make_embedded(value.getZExtValue());
+            auto const hash = detail::hash_apint(value);
+            if (auto id = find(value, hash); id.is_valid()) return id;
+            return insert(std::move(value), hash);
         }
-        
-        constexpr auto get(StringId id) noexcept -> std::string_view {
-            dark_assert(id.as_unsigned() < m_values.size(), "invalid id");
-            return m_values[id].borrow();
+
+        auto add(IntView value) -> IntId {
+            return add(value.to_apint());
         }
 
-        constexpr auto get(StringId id) const noexcept -> std::string_view const {
-            dark_assert(id.as_unsigned() < m_values.size(), "invalid id");
-            return m_values[id].borrow();
+        template <typename... Args>
+        auto emplace(Args&&... args) -> IntId {
+            return add(llvm::APInt(std::forward<Args>(args)...));
         }
 
-        constexpr auto find(std::string_view value) const noexcept -> StringId {
-            auto it = m_map.find(value);
-            if (it == m_map.end()) return StringId::invalid;
-            return it->second;
+        auto get(IntId id) const noexcept -> IntView {
+            if (id.is_embedded()) return IntView(id.get_embedded_value());
+            dark_assert(id.as_unsigned() < m_values.size(), "invalid id");
+            return IntView(m_values[id]);
         }
 
-        constexpr auto size() const noexcept -> std::size_t {
+        auto size() const noexcept -> std::size_t {
             return m_values.size();
         }
 
-        auto array_ref() const noexcept -> llvm::ArrayRef<CowString> {
+        auto array_ref() const noexcept -> llvm::ArrayRef<value_type> {
             return m_values;
         }
 
         auto reserve(std::size_t size) -> void {
             m_values.reserve(size);
+            m_index.reserve(size);
         }
 
         auto clear() -> void {
             m_values.clear();
-            m_map.clear();
+            m_index.clear();
         }
 
         auto output_yaml() const -> yaml::OutputMapping {
             return yaml::OutputMapping{[this](yaml::OutputMapping::Map map) {
                 for (auto i = 0u; i < m_values.size(); ++i) {
+                    map.put(print_to_string(i), yaml::OutputScalar(m_values[i]));
+                }
+            }};
+        }
+    private:
+        [[nodiscard]] static auto is_embeddable(llvm::APInt const& value) noexcept -> bool {
+            return !value.isNegative() && value.getActiveBits() <= IntId::embedded_bits;
+        }
+
+        auto find(llvm::APInt const& value, std::uint64_t hash) const -> IntId {
+            return IntId(m_index.find(hash, [&](IdBase::inner_type id) {
+                return detail::is_same_apint(m_values[static_cast<std::size_t>(id)], value);
+            }));
+        }
+
+        auto insert(llvm::APInt&& value, std::uint64_t hash) -> IntId {
+            auto id = IntId{static_cast<IntId::inner_type>(m_values.size())};
+            dark_assert(id.index >= 0, "overflow detected");
+            m_values.push_back(std::move(value));
+            m_index.insert(hash, id.index);
+            return id;
+        }
+
+        llvm::SmallVector<value_type, 0> m_values;
+        detail::ContentIndex m_index;
+    };
+
+    // Reals that are exactly a `double` are stored as one; the rest keep their
+    // mantissa and exponent. Both are stored once each, and `size` counts both.
+    template<>
+    struct ValueStore<RealId>: public yaml::Printable<ValueStore<RealId>> {
+        using value_type = Real;
+
+        auto add(Real const& value) -> RealId {
+            auto const hash = detail::ContentKey<Real>::hash(value);
+            if (auto id = find(value, hash); id.is_valid()) return id;
+            return insert(Real(value), hash);
+        }
+
+        auto add(Real&& value) -> RealId {
+            auto const hash = detail::ContentKey<Real>::hash(value);
+            if (auto id = find(value, hash); id.is_valid()) return id;
+            return insert(std::move(value), hash);
+        }
+
+        auto add(double value) -> RealId {
+            auto const bits = std::bit_cast<std::uint64_t>(value);
+            auto const hash = llvm::xxHash64(llvm::ArrayRef<std::uint8_t>(reinterpret_cast<std::uint8_t const*>(&bits), sizeof(bits)));
+            auto const index = m_double_index.find(hash, [&](IdBase::inner_type id) {
+                return std::bit_cast<std::uint64_t>(m_doubles[static_cast<std::size_t>(id)]) == bits;
+            });
+            if (index != IdBase::invalid) return RealId::make_double(static_cast<std::size_t>(index));
+
+            auto const id = RealId::make_double(m_doubles.size());
+            m_double_index.insert(hash, static_cast<IdBase::inner_type>(m_doubles.size()));
+            m_doubles.push_back(value);
+            return id;
+        }
+
+        auto add(RealView value) -> RealId {
+            return value.is_double() ? add(value.get_double()) : add(value.get_real());
+        }
+
+        template <typename... Args>
+        auto emplace(Args&&... args) -> RealId {
+            return add(Real(std::forward<Args>(args)...));
+        }
+
+        auto get(RealId id) const noexcept -> RealView {
+            if (id.is_double()) {
+                dark_assert(id.get_double_index() < m_doubles.size(), "invalid id");
+                return RealView(m_doubles[id.get_double_index()]);
+            }
+            dark_assert(id.as_unsigned() < m_values.size(), "invalid id");
+            return RealView(m_values[id]);
+        }
+
+        auto size() const noexcept -> std::size_t {
+            return m_values.size() + m_doubles.size();
+        }
+
+        // The reals kept as a `Real`, in id order.
+        auto array_ref() const noexcept -> llvm::ArrayRef<value_type> {
+            return m_values;
+        }
+
+        // The reals kept as a `double`, in the order of `get_double_index`.
+        auto double_array_ref() const noexcept -> llvm::ArrayRef<double> {
+            return m_doubles;
+        }
+
+        auto reserve(std::size_t size) -> void {
+            m_values.reserve(size);
+            m_index.reserve(size);
+        }
+
+        auto clear() -> void {
+            m_values.clear();
+            m_index.clear();
+            m_doubles.clear();
+            m_double_index.clear();
+        }
+
+        auto output_yaml() const -> yaml::OutputMapping {
+            return yaml::OutputMapping{[this](yaml::OutputMapping::Map map) {
+                for (auto i = 0u; i < m_values.size(); ++i) {
+                    map.put(print_to_string(RealId(i)), yaml::OutputScalar(m_values[i]));
+                }
+                for (auto i = 0u; i < m_doubles.size(); ++i) {
+                    map.put(print_to_string(RealId::make_double(i)), yaml::OutputScalar(m_doubles[i]));
+                }
+            }};
+        }
+    private:
+        auto find(Real const& value, std::uint64_t hash) const -> RealId {
+            return RealId(m_index.find(hash, [&](IdBase::inner_type id) {
+                return detail::ContentKey<Real>::equal(m_values[static_cast<std::size_t>(id)], value);
+            }));
+        }
+
+        auto insert(Real&& value, std::uint64_t hash) -> RealId {
+            auto id = RealId{static_cast<RealId::inner_type>(m_values.size())};
+            dark_assert(id.index >= 0, "overflow detected");
+            m_values.push_back(std::move(value));
+            m_index.insert(hash, id.index);
+            return id;
+        }
+
+        llvm::SmallVector<value_type, 0> m_values;
+        detail::ContentIndex m_index;
+        llvm::SmallVector<double, 0> m_doubles;
+        detail::ContentIndex m_double_index;
+    };
+
+    // Interns strings and can be shared by threads lexing different sources;
+    // see `StringInterner`. Owned strings are copied into the interner, borrowed
+    // ones must outlive the store.
+    template<>
+    struct ValueStore<StringId>: public yaml::Printable<ValueStore<StringId>> {
+        auto add(CowString value) -> StringId {
+            auto const view = value.borrow();
+            return add(view, StringInterner::hash(view), !value.is_borrowed());
+        }
+
+        auto add_borrowed(std::string_view value) -> StringId {
+            return add_borrowed(value, StringInterner::hash(value));
+        }
+
+        // `hash` must be `StringInterner::hash(value)`, for callers that already
+        // have it.
+        auto add_borrowed(std::string_view value, std::uint64_t hash) -> StringId {
+            return add(value, hash, false);
+        }
+        
+        auto get(StringId id) const noexcept -> std::string_view {
+            dark_assert(id.as_unsigned() < size(), "invalid id");
+            return m_interner.get(id);
+        }
+
+        auto find(std::string_view value) const noexcept -> StringId {
+            auto const index = m_interner.find(value, StringInterner::hash(value));
+            if (index == StringInterner::npos) return StringId::invalid;
+            return StringId(index);
+        }
+
+        auto size() const noexcept -> std::size_t {
+            return m_interner.size();
+        }
+
+        auto reserve(std::size_t size) -> void {
+            m_interner.reserve(size);
+        }
+
+        auto clear() -> void {
+            m_interner.clear();
+        }
+
+        auto output_yaml() const -> yaml::OutputMapping {
+            return yaml::OutputMapping{[this](yaml::OutputMapping::Map map) {
+                for (auto i = 0u; i < size(); ++i) {
                     auto id = StringId(i);
                     map.put(print_to_string(id), yaml::OutputScalar(get(id)));
                 }
             }};
         }
     private:
-        llvm::DenseMap<llvm::StringRef, StringId> m_map;
-        llvm::SmallVector<CowString, 0> m_values;
+        auto add(std::string_view value, std::uint64_t hash, bool copy) -> StringId {
+            auto const index = m_interner.intern(value, hash, copy);
+            dark_assert(index <= static_cast<std::size_t>(std::numeric_limits<StringId::inner_type>::max()), "overflow detected");
+            return StringId(index);
+        }
+
+        StringInterner m_interner;
     };
 
     template <detail::IsValueStoreValue T>
@@ -263,26 +745,26 @@ namespace dark {
         constexpr ~StringStoreWrapper() noexcept = default;
 
         auto add(CowString value) -> T {
-            return m_store->add(std::move(value));
+            return T(m_store->add(std::move(value)).index);
         }
 
         auto add_borrowed(std::string_view value) -> T {
             return T(m_store->add_borrowed(value).index);
         }
 
-        constexpr auto get(T id) noexcept -> std::string_view {
-            return m_store->get(StringId(id.index));
+        auto add_borrowed(std::string_view value, std::uint64_t hash) -> T {
+            return T(m_store->add_borrowed(value, hash).index);
         }
 
-        constexpr auto get(T id) const noexcept -> std::string_view const {
+        auto get(T id) const noexcept -> std::string_view {
             return m_store->get(StringId(id.index));
         }
 
-        constexpr auto size() const noexcept -> std::size_t {
+        auto size() const noexcept -> std::size_t {
             return m_store->size();
         }
 
-        constexpr auto find(std::string_view value) const noexcept -> T {
+        auto find(std::string_view value) const noexcept -> T {
             return T(m_store->find(value).index);
         }
 
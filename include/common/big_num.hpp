@@ -933,6 +933,19 @@ namespace dark {
             return temp;
         }
 
+        // Signed numbers get an extra bit so the sign survives the conversion.
+        [[nodiscard]] auto to_apint() const -> llvm::APInt requires (detail::IsBigIntegerKind<kind>) {
+            auto const bits = get_number_of_bits();
+            auto words = llvm::SmallVector<std::uint64_t, 4>((bits + 63) / 64, 0);
+            auto count = std::size_t{};
+            mpz_export(words.data(), &count, -1, sizeof(std::uint64_t), 0, 0, get_rep_t());
+
+            auto const width = static_cast<unsigned>(bits + (is_signed() ? 1 : 0));
+            auto result = llvm::APInt(width, words);
+            if (is_negative()) result.negate();
+            return result;
+        }
+
         [[nodiscard]] auto numerator() const -> BasicBigNum<BigNumKind::SignedInteger> requires (kind == BigNumKind::Real) {
             auto temp = BasicBigNum<BigNumKind::SignedInteger>();
             temp.m_value, std::move(m_value.get_num());
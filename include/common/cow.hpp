@@ -86,6 +86,10 @@ namespace dark {
             }, m_data);
         }
 
+        constexpr auto is_borrowed() const noexcept -> bool {
+            return std::holds_alternative<borrowed_type>(m_data);
+        }
+
         constexpr auto own() noexcept(std::is_nothrow_move_constructible_v<owned_type>) -> owned_type {
             return std::visit([]<typename T>(T& value) -> owned_type {
                 if constexpr (std::is_same_v<T, owned_type>) {
@@ -0,0 +1,28 @@
+#ifndef __DARK_COMMON_REAL_CONVERSION_HPP__
+#define __DARK_COMMON_REAL_CONVERSION_HPP__
+
+#include <cstdint>
+#include <llvm/ADT/APInt.h>
+#include <optional>
+
+namespace dark {
+
+    // `mantissa * 10^exponent`, rounded to nearest with ties to even. The
+    // Eisel-Lemire algorithm settles almost every input with one or two 64-bit
+    // multiplications; the rest are parsed by `llvm::APFloat`.
+    [[nodiscard]] auto decimal_to_double(std::uint64_t mantissa, std::int64_t exponent) -> double;
+
+    // Same for a mantissa and a signed exponent of any width.
+    [[nodiscard]] auto decimal_to_double(llvm::APInt const& mantissa, llvm::APInt const& exponent) -> double;
+
+    // `mantissa * 2^exponent`, rounded to nearest with ties to even.
+    [[nodiscard]] auto binary_to_double(llvm::APInt const& mantissa, llvm::APInt const& exponent) -> double;
+
+    // Return the `double` that is exactly `mantissa * 10^exponent`, or
+    // `mantissa * 2^exponent`, if there is one.
+    [[nodiscard]] auto exact_decimal_to_double(std::uint64_t mantissa, std::int64_t exponent) -> std::optional<double>;
+    [[nodiscard]] auto exact_binary_to_double(std::uint64_t mantissa, std::int64_t exponent) noexcept -> std::optional<double>;
+
+} // namespace dark
+
+#endif // __DARK_COMMON_REAL_CONVERSION_HPP__
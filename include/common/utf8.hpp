@@ -2,11 +2,20 @@
 #define __DARK_COMMON_UTF8_HPP__
 
 #include <array>
+#include <bit>
+#include <cstddef>
 #include <cstdint>
+#include <optional>
 #include <string_view>
 #include <utility>
 #include <simdutf.h>
 
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
 namespace dark::utf8 {
     static constexpr std::array<std::uint8_t, 16> utf_8_lookup { 
         1, 1, 1, 1, 1, 1, 1, 1, 
@@ -18,17 +27,141 @@ namespace dark::utf8 {
         return utf_8_lookup[byte >> 4];
     }
 
+    struct DecodedCodePoint {
+        char32_t code_point;
+        // Zero if the bytes do not start with a well-formed code point.
+        std::uint8_t length;
+    };
+
+    // Decodes the code point at the start of `str`, reading at most four bytes.
+    // Overlong forms, surrogates and values past U+10FFFF are rejected.
+    constexpr auto decode(std::string_view const str) noexcept -> DecodedCodePoint {
+        constexpr auto invalid = DecodedCodePoint{ .code_point = 0, .length = 0 };
+        constexpr std::array<std::uint8_t, 5> lead_mask { 0, 0x7F, 0x1F, 0x0F, 0x07 };
+        constexpr std::array<char32_t, 5> min_code_point { 0, 0, 0x80, 0x800, 0x10000 };
+
+        if (str.empty()) return invalid;
+
+        auto const lead = static_cast<std::uint8_t>(str[0]);
+        if (lead < 0x80) return { .code_point = lead, .length = 1 };
+
+        auto const length = get_utf8_length(str[0]);
+        // Continuation bytes share the length of ASCII in the lookup table.
+        if (length == 1 || lead >= 0xF8 || str.size() < length) return invalid;
+
+        auto code_point = static_cast<char32_t>(lead & lead_mask[length]);
+        for (auto i = 1u; i < length; ++i) {
+            auto const byte = static_cast<std::uint8_t>(str[i]);
+            if ((byte & 0xC0) != 0x80) return invalid;
+            code_point = (code_point << 6) | (byte & 0x3F);
+        }
+
+        if (
+            code_point < min_code_point[length] ||
+            code_point > 0x10FFFF ||
+            (code_point >= 0xD800 && code_point <= 0xDFFF)
+        ) {
+            return invalid;
+        }
+
+        return { .code_point = code_point, .length = length };
+    }
+
+    // Returns the first code point of `str` and its size in bytes, or a size of
+    // zero if `str` does not start with a well-formed code point.
     constexpr auto valid_utf8_character_with_char_len(std::string_view const str) -> std::pair<char32_t, std::size_t> {
-        char32_t code_point{};
-        auto length = simdutf::convert_utf8_to_utf32(str.data(), str.size(), &code_point);
-        
-        return {code_point, length};
+        auto [code_point, length] = decode(str);
+        return { code_point, length };
     }
 
+    // Walks a UTF-8 string one code point at a time.
+    struct Utf8Cursor {
+        constexpr Utf8Cursor() noexcept = default;
+        constexpr explicit Utf8Cursor(std::string_view text, std::size_t position = 0) noexcept
+            : m_text(text)
+            , m_position(position)
+        {}
+        constexpr Utf8Cursor(Utf8Cursor const&) noexcept = default;
+        constexpr Utf8Cursor(Utf8Cursor&&) noexcept = default;
+        constexpr Utf8Cursor& operator=(Utf8Cursor const&) noexcept = default;
+        constexpr Utf8Cursor& operator=(Utf8Cursor&&) noexcept = default;
+        constexpr ~Utf8Cursor() noexcept = default;
+
+        [[nodiscard]] constexpr auto position() const noexcept -> std::size_t { return m_position; }
+        [[nodiscard]] constexpr auto is_end() const noexcept -> bool { return m_position >= m_text.size(); }
+        [[nodiscard]] constexpr auto rest() const noexcept -> std::string_view { return m_text.substr(m_position); }
+
+        // Byte at the cursor; zero at the end.
+        [[nodiscard]] constexpr auto byte() const noexcept -> char {
+            return is_end() ? '\0' : m_text[m_position];
+        }
+
+        [[nodiscard]] constexpr auto is_ascii() const noexcept -> bool {
+            return static_cast<std::uint8_t>(byte()) < 0x80;
+        }
+
+        // Decodes the code point at the cursor without moving it.
+        [[nodiscard]] constexpr auto peek() const noexcept -> DecodedCodePoint {
+            return decode(m_text.substr(m_position, 4));
+        }
+
+        // Moves past the code point at the cursor. Leaves the cursor in place and
+        // returns `std::nullopt` if the bytes are not well-formed.
+        constexpr auto next() noexcept -> std::optional<char32_t> {
+            auto [code_point, length] = peek();
+            if (length == 0) return std::nullopt;
+            m_position += length;
+            return code_point;
+        }
+
+        constexpr auto advance(std::size_t bytes) noexcept -> void {
+            m_position += bytes;
+        }
+
+        // Moves past every ASCII byte, stopping at the first non-ASCII byte or
+        // at the end.
+        auto skip_ascii() noexcept -> void {
+            auto const data = m_text.data();
+            auto const size = m_text.size();
+        #if defined(__AVX2__)
+            for (; m_position + 64 <= size; m_position += 64) {
+                auto const lo = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + m_position));
+                auto const hi = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + m_position + 32));
+                auto const mask = static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(lo)))
+                    | (static_cast<std::uint64_t>(static_cast<std::uint32_t>(_mm256_movemask_epi8(hi))) << 32);
+                if (mask != 0) {
+                    m_position += static_cast<std::size_t>(std::countr_zero(mask));
+                    return;
+                }
+            }
+        #elif defined(__SSE2__)
+            for (; m_position + 32 <= size; m_position += 32) {
+                auto const lo = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + m_position));
+                auto const hi = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + m_position + 16));
+                auto const mask = static_cast<std::uint32_t>(_mm_movemask_epi8(lo))
+                    | (static_cast<std::uint32_t>(_mm_movemask_epi8(hi)) << 16);
+                if (mask != 0) {
+                    m_position += static_cast<std::size_t>(std::countr_zero(mask));
+                    return;
+                }
+            }
+        #endif
+            while (m_position < size && static_cast<std::uint8_t>(data[m_position]) < 0x80) ++m_position;
+        }
+
+    private:
+        std::string_view m_text{};
+        std::size_t m_position{};
+    };
+
     constexpr auto is_string_utf8(std::string_view const str) -> bool {
         return simdutf::validate_utf8(str.data(), str.size());
     }
 
+    constexpr auto is_string_ascii(std::string_view const str) -> bool {
+        return simdutf::validate_ascii(str.data(), str.size());
+    }
+
     constexpr auto utf32_to_utf8(char32_t code_point, char* buffer) -> std::size_t {
         return simdutf::convert_utf32_to_utf8(&code_point, 1, buffer);
     }
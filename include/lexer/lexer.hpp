@@ -0,0 +1,97 @@
+#ifndef __DARK_LEXER_LEXER_HPP__
+#define __DARK_LEXER_LEXER_HPP__
+
+#include "base/value_store.hpp"
+#include "diagnostics/diagnostic_consumer.hpp"
+#include "lexer/token_buffer.hpp"
+#include "source/source_buffer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+
+namespace dark::lexer {
+
+    struct Lexer {
+        // When literal values are computed. `Eager` computes each one as it is
+        // lexed. `Batch` computes them all after lexing, grouped by kind and
+        // radix on several threads, with the same tokens, ids and diagnostics
+        // as `Eager`. `Lazy` records only the span and kind of a literal and
+        // computes its value on first access through the token buffer, or in
+        // `TokenizedBuffer::materialize_all`. The buffer holds diagnostics about
+        // the values until `materialize_all` reports them to its consumer.
+        // Until then, reading the buffer writes to the shared value stores and
+        // must stay on one thread per `SharedValueStores`.
+        enum class LiteralMode: std::uint8_t {
+            Eager,
+            Batch,
+            Lazy
+        };
+
+        // Lexes the whole source buffer into a token buffer. Every value produced by
+        // the lexer (identifiers, literals) is interned into `value_stores`.
+        [[nodiscard]] static auto lex(
+            SourceBuffer& source,
+            SharedValueStores& value_stores,
+            DiagnosticConsumer& consumer,
+            LiteralMode literal_mode = LiteralMode::Eager
+        ) -> TokenizedBuffer;
+
+        static constexpr auto default_chunk_size = std::size_t{ 1 } << 20;
+
+        // `lex_parallel` turns `Eager` into `Batch` for sources at least this big.
+        static constexpr auto batch_literal_threshold = std::size_t{ 1 } << 18;
+
+        // Same as `lex`, but splits the source into chunks of about `chunk_size`
+        // bytes at line boundaries and lexes them on up to `thread_count` threads
+        // (0 uses every hardware thread). The tokens, the diagnostics and the
+        // interned values come out identical to `lex`. `Batch` literals are
+        // converted on the same threads.
+        [[nodiscard]] static auto lex_parallel(
+            SourceBuffer& source,
+            SharedValueStores& value_stores,
+            DiagnosticConsumer& consumer,
+            unsigned thread_count = 0,
+            std::size_t chunk_size = default_chunk_size,
+            LiteralMode literal_mode = LiteralMode::Eager
+        ) -> TokenizedBuffer;
+
+        // Lexes every source on up to `thread_count` threads (0 uses every
+        // hardware thread) and returns the buffers in the order of `sources`.
+        // Values are interned and diagnostics reported as if the sources were
+        // passed to `lex` one after another, whatever the scheduling.
+        //
+        // With a `cache_directory`, sources that have a `TokenSnapshot` there are
+        // loaded instead of lexed, and sources that lex without diagnostics get
+        // one written.
+        [[nodiscard]] static auto lex_batch(
+            llvm::ArrayRef<SourceBuffer*> sources,
+            SharedValueStores& value_stores,
+            DiagnosticConsumer& consumer,
+            unsigned thread_count = 0,
+            llvm::StringRef cache_directory = {}
+        ) -> llvm::SmallVector<TokenizedBuffer, 0>;
+
+    private:
+        [[nodiscard]] static auto lex_source(
+            SourceBuffer& source,
+            SharedValueStores& value_stores,
+            DiagnosticConsumer& consumer,
+            LiteralMode literal_mode,
+            unsigned thread_count
+        ) -> TokenizedBuffer;
+
+        // Moves the values `tokens` interned into its own stores over to
+        // `value_stores` and rewrites the token payloads to match.
+        static auto rebind_values(TokenizedBuffer& tokens, SharedValueStores& value_stores) -> void;
+
+        // Sources that are pure ASCII get an instantiation without any UTF-8
+        // decoding.
+        template <bool AsciiOnly>
+        struct Impl;
+    };
+
+} // namespace dark::lexer
+
+#endif // __DARK_LEXER_LEXER_HPP__
@@ -4,6 +4,8 @@
 #include "common/big_num.hpp"
 #include "common/cow.hpp"
 #include "diagnostics/diagnostic_emitter.hpp"
+#include <algorithm>
+#include <bit>
 #include <cstdint>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/ADT/APInt.h>
@@ -20,14 +22,43 @@ namespace dark::lexer {
             Hexadecimal = 16
         };
 
+        // An integer held in a machine word while it fits, and in a
+        // `SignedBigNum` only once it does not.
+        struct Integer {
+            struct Fixed {
+                std::uint64_t magnitude{};
+                bool is_negative{false};
+            };
+
+            std::variant<Fixed, SignedBigNum> value;
+
+            [[nodiscard]] auto is_fixed() const noexcept -> bool {
+                return std::holds_alternative<Fixed>(value);
+            }
+
+            // Both forms give the same `APInt` for the same number, with the
+            // width `SignedBigNum::to_apint` uses.
+            [[nodiscard]] auto to_apint() const -> llvm::APInt {
+                if (auto const* big = std::get_if<SignedBigNum>(&value)) return big->to_apint();
+                auto const& fixed = std::get<Fixed>(value);
+                auto const width = std::max(static_cast<unsigned>(std::bit_width(fixed.magnitude)), 1u) + 2;
+                auto result = llvm::APInt(width, fixed.magnitude);
+                if (fixed.is_negative) result.negate();
+                return result;
+            }
+        };
+
         struct IntValue {
-            SignedBigNum value;
+            Integer value;
         };
 
         struct RealValue {
             Radix radix{ Radix::Decimal };
-            SignedBigNum mantissa;
-            SignedBigNum exponent;
+            Integer mantissa;
+            Integer exponent;
+
+            // The `double` equal to this value, if there is one.
+            [[nodiscard]] auto get_exact_double() const -> std::optional<double>;
         };
 
         struct UnrecoverableError {};
@@ -40,6 +71,17 @@ namespace dark::lexer {
 
         constexpr auto get_source() const -> llvm::StringRef { return m_source; }
 
+        // The radix that the prefix of `spelling` selects.
+        [[nodiscard]] static constexpr auto get_radix(llvm::StringRef spelling) noexcept -> Radix {
+            if (spelling.starts_with("0x")) return Radix::Hexadecimal;
+            if (spelling.starts_with("0b")) return Radix::Binary;
+            if (spelling.starts_with("0o")) return Radix::Octal;
+            return Radix::Decimal;
+        }
+
+        // Whether `compute_value` gives an `IntValue`, unless it gives an error.
+        [[nodiscard]] constexpr auto is_integer() const noexcept -> bool { return m_radix_point == m_source.size(); }
+
     private:
         struct Parser;
     
@@ -6,24 +6,33 @@
 #include "common/ostream.hpp"
 #include "base/value_store.hpp"
 #include "diagnostics/basic_diagnostic.hpp"
+#include "diagnostics/diagnostic_consumer.hpp"
 #include "diagnostics/diagnostic_emitter.hpp"
 #include "diagnostics/dianostic_converter.hpp"
+#include "lexer/numeric_literal.hpp"
 #include "lexer/token_kind.hpp"
 #include "source/source_buffer.hpp"
 #include <cstddef>
 #include <cstdint>
 #include <iterator>
+#include <limits>
+#include <llvm/ADT/BitVector.h>
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/ADT/iterator.h>
 #include <llvm/Support/Allocator.h>
 #include <llvm/Support/raw_ostream.h>
 #include <memory>
+#include <mutex>
+#include <type_traits>
 #include <utility>
+#include <variant>
 
 namespace dark::lexer {
 
     struct TokenizedBuffer;
+    struct TokenSnapshot;
+    struct Lexer;
 
     struct TokenIndex: public IndexBase {
         using IndexBase::IndexBase;
@@ -44,7 +53,7 @@ namespace dark::lexer {
     constexpr LineIndex LineIndex::invalid = LineIndex();
 
     struct TokenIterator: 
-        public llvm::iterator_facade_base<TokenIterator, std::random_access_iterator_tag, TokenIndex const, int>,
+        public llvm::iterator_facade_base<TokenIterator, std::random_access_iterator_tag, TokenIndex const, IdBase::inner_type>,
         public Printable<TokenIterator>
     {
         TokenIterator() = delete;
@@ -73,21 +82,21 @@ namespace dark::lexer {
         }
 
         using iterator_facade_base::operator-;
-        constexpr auto operator-(TokenIterator const& other) const noexcept -> int {
+        constexpr auto operator-(TokenIterator const& other) const noexcept -> difference_type {
             return m_token.index - other.m_token.index;
         }
 
         using iterator_facade_base::operator+;
-        constexpr auto operator+(int n) const noexcept -> TokenIterator {
+        constexpr auto operator+(difference_type n) const noexcept -> TokenIterator {
             return TokenIterator(TokenIndex(m_token.index + n));
         }
 
-        constexpr auto operator+=(int n) noexcept -> TokenIterator& {
+        constexpr auto operator+=(difference_type n) noexcept -> TokenIterator& {
             m_token.index += n;
             return *this;
         }
 
-        constexpr auto operator-=(int n) noexcept -> TokenIterator& {
+        constexpr auto operator-=(difference_type n) noexcept -> TokenIterator& {
             m_token.index -= n;
             return *this;
         }
@@ -116,85 +125,106 @@ namespace dark::lexer {
         TokenizedBuffer const* m_buffer;
     };
 
+    static_assert(sizeof(TokenKind) == 1, "Token kinds are stored densely, one byte per token");
+
     struct TokenizedBuffer: public Printable<TokenizedBuffer> {
+        // Byte offsets into the source; follows the width of `IdBase`.
+        using offset_type = std::make_unsigned_t<IdBase::inner_type>;
+
         [[nodiscard]] constexpr auto get_kind(TokenIndex token) const noexcept -> TokenKind {
-            return get_token_info(token).kind;
+            return m_kinds[token];
         }
 
-        [[nodiscard]] constexpr auto get_line(TokenIndex token) const noexcept -> LineIndex {
-            return get_token_info(token).line;
-        }
+        // Lines and columns are not stored per token; they are recovered from the
+        // token's offset through the source's line table.
+        [[nodiscard]] auto get_line(TokenIndex token) const noexcept -> LineIndex;
 
-        [[nodiscard]] constexpr auto get_line_number(TokenIndex token) const noexcept -> unsigned {
+        [[nodiscard]] auto get_line_number(TokenIndex token) const noexcept -> offset_type {
             return get_line_number(get_line(token));
         }
 
-        [[nodiscard]] constexpr auto get_line_number(LineIndex line) const noexcept -> unsigned {
+        [[nodiscard]] constexpr auto get_line_number(LineIndex line) const noexcept -> offset_type {
             return line.as_unsigned() + 1;
         }
 
-        [[nodiscard]] constexpr auto get_column_number(TokenIndex index) const noexcept -> unsigned {
-            return static_cast<unsigned>(std::max(get_token_info(index).column + 1, 0));
-        }
-        
-        [[nodiscard]] constexpr auto get_indent_column_number(LineIndex index) const noexcept -> unsigned {
-            return get_line_info(index).indent + 1;
-        }
+        [[nodiscard]] auto get_column_number(TokenIndex index) const noexcept -> offset_type;
+
+        // Column of the first non-whitespace character on the line, or 1 for a
+        // blank line.
+        [[nodiscard]] auto get_indent_column_number(LineIndex index) const noexcept -> offset_type;
 
         [[nodiscard]] constexpr auto get_identifier(TokenIndex token) const noexcept -> IdentifierId {
-            auto const& info = get_token_info(token);
-            return info.id;
+            return m_payloads[token].id;
         }
         
-        [[nodiscard]] constexpr auto get_int_literal(TokenIndex token) const noexcept -> IntId {
-            auto const& info = get_token_info(token);
-            return info.integer;
+        // Literals lexed lazily get their value on first access, which adds it
+        // to the int and real stores of the `SharedValueStores`. Those stores
+        // are not synchronized, so lazy reads must not overlap any other use of
+        // the same stores; call `materialize_all` before sharing the buffer
+        // between threads. A numeric literal whose value cannot be computed keeps its kind and
+        // reads as an invalid id until `materialize_all` turns it into an
+        // `Error` token.
+        [[nodiscard]] auto get_int_literal(TokenIndex token) const -> IntId {
+            materialize(token);
+            return m_payloads[token].integer;
         }
         
-        [[nodiscard]] auto get_real_literal(TokenIndex token) const noexcept -> RealId {
-            auto const& info = get_token_info(token);
-            return info.reals;
+        [[nodiscard]] auto get_real_literal(TokenIndex token) const -> RealId {
+            materialize(token);
+            return m_payloads[token].reals;
+        }
+
+        [[nodiscard]] auto get_string_literal(TokenIndex token) const -> StringLiteralId {
+            materialize(token);
+            return m_payloads[token].string_literal;
         }
 
-        [[nodiscard]] constexpr auto get_string_literal(TokenIndex token) const noexcept -> StringLiteralId {
-            auto const& info = get_token_info(token);
-            return info.string_literal;
+        // True for a lazily lexed buffer until `materialize_all` runs.
+        [[nodiscard]] auto has_pending_literals() const noexcept -> bool {
+            return m_lazy != nullptr || m_pending_count != 0;
         }
 
+        // Computes every pending literal on up to `thread_count` threads (0 uses
+        // every hardware thread) and interns the values in token order. The
+        // diagnostics about literal values, including those of literals read
+        // before, go to `consumer` in token order, and literals whose value
+        // could not be computed become `Error` tokens. The kinds, `has_error`
+        // and the diagnostics then match eager lexing. If nothing was read
+        // before, so do the int and real ids; string literal ids can differ,
+        // since their store also holds the identifiers interned while lexing.
+        auto materialize_all(DiagnosticConsumer& consumer, unsigned thread_count = 1) -> void;
+
         [[nodiscard]] constexpr auto get_type_literal_size(TokenIndex token) const noexcept -> IntId {
-            auto const& info = get_token_info(token);
-            return info.integer;
+            return m_payloads[token].integer;
         }
 
         [[nodiscard]] constexpr auto get_matched_closing_token(TokenIndex opening_token) const noexcept -> TokenIndex {
-            auto const& info = get_token_info(opening_token);
-            dark_assert(info.kind.is_opening_symbol(), "Token is not an opening token!");
-            return info.close_paren;
+            dark_assert(get_kind(opening_token).is_opening_symbol(), "Token is not an opening token!");
+            return m_payloads[opening_token].close_paren;
         }
         
         [[nodiscard]] constexpr auto get_matched_opening_token(TokenIndex closing_token) const noexcept -> TokenIndex {
-            auto const& info = get_token_info(closing_token);
-            dark_assert(info.kind.is_closing_symbol(), "Token is not a closing token!");
-            return info.open_paren;
+            dark_assert(get_kind(closing_token).is_closing_symbol(), "Token is not a closing token!");
+            return m_payloads[closing_token].open_paren;
         }
 
         [[nodiscard]] auto has_leading_whitespace(TokenIndex token) const noexcept -> bool {
             auto it = TokenIterator(token);
-            return it == tokens().begin() || get_token_info(*(it - 1)).has_trailing_space;
+            return it == tokens().begin() || has_trailing_whitespace(*(it - 1));
         }
-        [[nodiscard]] constexpr auto has_trailing_whitespace(TokenIndex token) const noexcept -> bool {
-            return get_token_info(token).has_trailing_space;
+        [[nodiscard]] auto has_trailing_whitespace(TokenIndex token) const noexcept -> bool {
+            return m_trailing_space[to_bit_index(token)];
         }
 
-        [[nodiscard]] auto get_end_loc(TokenIndex token) const noexcept -> std::pair<LineIndex, unsigned>;
+        [[nodiscard]] auto get_end_loc(TokenIndex token) const noexcept -> std::pair<LineIndex, offset_type>;
         [[nodiscard]] auto get_token_text(TokenIndex token) const noexcept -> llvm::StringRef;
-        [[nodiscard]] constexpr auto is_recovery_token(TokenIndex token) const noexcept -> bool {
-            return get_token_info(token).is_recovery;
+        [[nodiscard]] auto is_recovery_token(TokenIndex token) const noexcept -> bool {
+            return m_recovery[to_bit_index(token)];
         }
 
-        [[nodiscard]] constexpr auto get_next_line(LineIndex token) const noexcept -> LineIndex {
+        [[nodiscard]] auto get_next_line(LineIndex token) const noexcept -> LineIndex {
             auto line = LineIndex(token.index + 1);
-            dark_assert(static_cast<std::size_t>(line.index) < m_line_infos.size(), "LineIndex overflow!");
+            dark_assert(static_cast<std::size_t>(line.index) < m_source->get_line_table().size(), "LineIndex overflow!");
             return line;
         }
         [[nodiscard]] constexpr auto get_prev_line(LineIndex token) const noexcept -> LineIndex {
@@ -205,18 +235,22 @@ namespace dark::lexer {
         auto print(llvm::raw_ostream& os) const -> void;
         auto print_token(llvm::raw_ostream& os, TokenIndex token) const -> void;
 
+        // Errors in the values of lazily lexed literals only count once
+        // `materialize_all` ran.
         constexpr auto has_error() const noexcept -> bool { return m_has_errors; }
         auto tokens() const noexcept -> llvm::iterator_range<TokenIterator> {
-            return llvm::make_range(TokenIterator(TokenIndex(0)), TokenIterator(TokenIndex(m_token_infos.size())));
+            return llvm::make_range(TokenIterator(TokenIndex(0)), TokenIterator(TokenIndex(m_kinds.size())));
         }
 
-        [[nodiscard]] constexpr auto size() const noexcept -> std::size_t { return m_token_infos.size(); }
+        [[nodiscard]] constexpr auto size() const noexcept -> std::size_t { return m_kinds.size(); }
         [[nodiscard]] constexpr auto expected_parse_tree_size() const noexcept -> int { return m_expected_parse_tree_size; }
         [[nodiscard]] constexpr auto source() const noexcept -> SourceBuffer const& { return *m_source; }
 
     private:
         friend struct TokenIterator;
         friend struct TokenDiagnosticConverter;
+        friend struct Lexer;
+        friend struct TokenSnapshot;
 
     private:
         explicit TokenizedBuffer(SharedValueStores& value_store, SourceBuffer& source)
@@ -257,88 +291,157 @@ namespace dark::lexer {
             unsigned indent;
         };
 
+        // Everything the lexer knows about a token when it adds it.
         struct TokenInfo {
             TokenKind kind;
-            bool has_trailing_space;
             bool is_recovery;
-            LineIndex line;
-            int32_t column;
-
-            union {
-                static_assert(sizeof(TokenIndex) <= sizeof(int32_t), "Unable to pack token and identifier index into the same space!");
-                IdentifierId id = IdentifierId::invalid;
-                StringLiteralId string_literal;
-                IntId integer;
-                RealId reals;
-                TokenIndex open_paren;
-                TokenIndex close_paren;
-                int32_t error_length;
-            };
+            offset_type offset;
+            offset_type length;
         };
 
-        struct LineInfo {
-            static constexpr unsigned npos = ~0u;
-            constexpr explicit LineInfo(unsigned start) noexcept
-                : start(start)
-                , length(static_cast<unsigned>(llvm::StringRef::npos))
-                , indent(0)
+        // What a token carries besides its kind; `kind` decides which member is
+        // active.
+        union TokenPayload {
+            static_assert(sizeof(TokenIndex) <= sizeof(IdBase::inner_type), "Unable to pack token and identifier index into the same space!");
+            constexpr TokenPayload() noexcept
+                : id(IdentifierId::invalid)
             {
             }
 
-            constexpr LineInfo(unsigned start, unsigned length) noexcept
-                : start(start)
-                , length(length)
-                , indent(0)
-            {
-            }
+            IdentifierId id;
+            StringLiteralId string_literal;
+            IntId integer;
+            RealId reals;
+            TokenIndex open_paren;
+            TokenIndex close_paren;
+        };
 
-            constexpr LineInfo(LineInfo const&) noexcept = default;
-            constexpr LineInfo(LineInfo&&) noexcept = default;
-            constexpr LineInfo& operator=(LineInfo const&) noexcept = default;
-            constexpr LineInfo& operator=(LineInfo&&) noexcept = default;
-            constexpr ~LineInfo() noexcept = default;
+        static_assert(sizeof(TokenPayload) == sizeof(IdBase::inner_type), "Token payloads are expected to be a single index");
 
-            unsigned start;
-            unsigned length;
-            unsigned indent;
-        };
+        // The value of a numeric or string literal before it is interned.
+        using LiteralValue = std::variant<NumericLiteral::value_type, llvm::StringRef>;
 
+        // A diagnostic about the value of the literal at `offset`.
+        struct LiteralDiagnostic {
+            offset_type offset;
+            Diagnostic diagnostic;
+        };
 
-        [[nodiscard]] constexpr auto get_line_info(LineIndex line) const noexcept -> LineInfo const& {
-            return m_line_infos[line];
-        }
+        // What a lazily lexed buffer keeps from the literals read before
+        // `materialize_all`, which reports and applies it.
+        struct LazyLiterals {
+            std::mutex mutex;
+            llvm::SmallVector<LiteralDiagnostic, 0> diagnostics;
+            llvm::SmallVector<TokenIndex, 0> failed;
+        };
 
-        [[nodiscard]] constexpr auto get_line_info(LineIndex line) noexcept -> LineInfo& {
-            return m_line_infos[line];
+        [[nodiscard]] constexpr auto get_payload(TokenIndex token) noexcept -> TokenPayload& {
+            return m_payloads[token];
         }
 
-        [[nodiscard]] constexpr auto get_token_info(TokenIndex line) const noexcept -> TokenInfo const& {
-            return m_token_infos[line];
+        auto set_trailing_space(TokenIndex token) -> void {
+            m_trailing_space.set(to_bit_index(token));
         }
 
-        [[nodiscard]] constexpr auto get_token_info(TokenIndex line) noexcept -> TokenInfo& {
-            return m_token_infos[line];
+        // `llvm::BitVector` indexes with `unsigned`, so the per-token bit sets
+        // cap the token count at 2^32 even when ids are 64 bits wide.
+        [[nodiscard]] static auto to_bit_index(TokenIndex token) noexcept -> unsigned {
+            dark_assert(token.as_unsigned() <= std::numeric_limits<unsigned>::max(), "Token index does not fit a bit vector index");
+            return static_cast<unsigned>(token.index);
         }
 
         [[nodiscard]] auto add_token(TokenInfo info) -> TokenIndex {
-            auto id = TokenIndex(static_cast<std::size_t>(m_token_infos.size()));
+            auto id = TokenIndex(static_cast<std::size_t>(m_kinds.size()));
             dark_assert(id.index >= 0, "TokenIndex overflow!");
-            m_token_infos.emplace_back(std::move(info));
+            dark_assert(m_kinds.size() < std::numeric_limits<unsigned>::max(), "Too many tokens for the per-token bit vectors");
+            m_kinds.push_back(info.kind);
+            m_trailing_space.push_back(false);
+            m_recovery.push_back(info.is_recovery);
+            m_offsets.push_back(info.offset);
+            m_payloads.emplace_back();
+            m_lengths.push_back(info.length);
             m_expected_parse_tree_size += info.kind.expected_parse_tree_size();
             return id;
         }
 
+        [[nodiscard]] constexpr auto get_token_offset(TokenIndex token) const noexcept -> offset_type {
+            return m_offsets[token];
+        }
+
+        [[nodiscard]] auto is_pending(TokenIndex token) const noexcept -> bool {
+            return token.as_unsigned() < m_pending.size() && m_pending[to_bit_index(token)];
+        }
+
+        // Only the lexer's lazy mode marks tokens, so eager buffers never size
+        // `m_pending`.
+        auto mark_pending(TokenIndex token) -> void {
+            auto const index = to_bit_index(token);
+            if (index >= m_pending.size()) m_pending.resize(index + 1);
+            m_pending.set(index);
+            ++m_pending_count;
+        }
+
+        auto clear_pending(TokenIndex token) const -> void {
+            if (!is_pending(token)) return;
+            m_pending.reset(to_bit_index(token));
+            --m_pending_count;
+        }
+
+        // Only lazily lexed buffers are read with literals pending; a batch
+        // converts them before the lexer returns.
+        auto materialize(TokenIndex token) const -> void {
+            if (m_lazy != nullptr) materialize_pending(token);
+        }
+
+        auto materialize_pending(TokenIndex token) const -> void;
+
+        // The batch pass behind `materialize_all`. Pending literals are grouped by
+        // kind and radix and converted in chunks on up to `thread_count` threads,
+        // then interned in token order along with any pending identifiers.
+        // Returns their diagnostics in token order.
+        [[nodiscard]] auto compute_pending_literals(unsigned thread_count) -> llvm::SmallVector<LiteralDiagnostic, 0>;
+
+        // Lexes the literal at `token` again and computes its value.
+        [[nodiscard]] auto compute_literal_value(
+            TokenIndex token,
+            llvm::BumpPtrAllocator& allocator,
+            DiagnosticEmitter<char const*>& emitter
+        ) const -> LiteralValue;
+
+        // Interns `value` as the payload of `token`. Returns false, leaving an
+        // invalid id, if the value could not be computed.
+        [[nodiscard]] auto set_literal_value(TokenIndex token, LiteralValue const& value) const -> bool;
+
+        // Turns a literal whose value could not be computed into an error token.
+        auto set_literal_error(TokenIndex token) -> void;
+
         [[nodiscard]] auto get_print_widths(TokenIndex token) const noexcept -> PrintWidths;
 
         auto print_token(llvm::raw_ostream& os, TokenIndex token, PrintWidths widths) const -> void;
 
     private:
-        llvm::BumpPtrAllocator m_allocator;
+        // Members written by `materialize` are mutable, since literals are
+        // materialized through the const getters. `m_lazy->mutex` guards only
+        // this buffer's state, not the shared value stores.
+        mutable llvm::BumpPtrAllocator m_allocator;
         SharedValueStores* m_value_store;
         SourceBuffer* m_source;
         llvm::SmallVector<std::unique_ptr<std::string>> m_computed_strings;
-        llvm::SmallVector<TokenInfo> m_token_infos;
-        llvm::SmallVector<LineInfo> m_line_infos;
+        // Token storage is split by access pattern so that passes which only look
+        // at kinds do not pull offsets and payloads through the cache. Every
+        // array is indexed by `TokenIndex`.
+        llvm::SmallVector<TokenKind> m_kinds;
+        llvm::BitVector m_trailing_space;
+        llvm::BitVector m_recovery;
+        llvm::SmallVector<offset_type> m_offsets;
+        mutable llvm::SmallVector<TokenPayload> m_payloads;
+        llvm::SmallVector<offset_type> m_lengths;
+        // Literals whose value is not computed yet. A batch also leaves
+        // identifiers pending until its pass.
+        mutable llvm::BitVector m_pending;
+        mutable std::size_t m_pending_count{};
+        // Set while a lazily lexed buffer has not been through `materialize_all`.
+        std::unique_ptr<LazyLiterals> m_lazy;
         int m_expected_parse_tree_size{};
         bool m_has_errors{false};
     };
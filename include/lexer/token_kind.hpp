@@ -4,10 +4,16 @@
 #include "common/assert.hpp"
 #include "common/cow.hpp"
 #include "common/enum.hpp"
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
 #include <initializer_list>
 #include <llvm/ADT/ArrayRef.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/Support/raw_ostream.h>
+#include <utility>
+
 namespace dark::lexer {
 
     DARK_DEFINE_RAW_ENUM_CLASS(TokenKind, std::uint8_t) {
@@ -15,6 +21,44 @@ namespace dark::lexer {
         #include "lexer/token_kind.def"
     };
 
+    namespace detail {
+        // Must match `keyword_hash_key` in tools/generator/token_kind.py.
+        [[nodiscard]] constexpr auto keyword_hash_key(llvm::StringRef text) noexcept -> std::uint64_t {
+            auto const size = text.size();
+            auto const byte = [text](std::size_t i) {
+                return static_cast<std::uint64_t>(static_cast<unsigned char>(text[i]));
+            };
+            return (static_cast<std::uint64_t>(size) & 0xFF)
+                | byte(0) << 8
+                | byte(std::min<std::size_t>(1, size - 1)) << 16
+                | byte(size - 1) << 24
+                | byte(size < 2 ? 0 : size - 2) << 32;
+        }
+
+        struct KeywordHash {
+            std::uint64_t seed;
+            unsigned bits;
+
+            [[nodiscard]] constexpr auto slot(llvm::StringRef text) const noexcept -> std::size_t {
+                if (bits == 0) return 0;
+                return static_cast<std::size_t>((keyword_hash_key(text) * seed) >> (64 - bits));
+            }
+        };
+
+        inline constexpr auto keyword_hash = []() -> KeywordHash {
+            #define DARK_KEYWORD_HASH(Seed, Bits) return { .seed = Seed, .bits = Bits };
+            #include "lexer/token_kind.def"
+        }();
+
+        // Empty slots hold `Error`, which is the zero value.
+        inline constexpr auto keyword_hash_slots = []() {
+            auto slots = std::array<TokenKindRawEnum, std::size_t{1} << keyword_hash.bits>{};
+            #define DARK_KEYWORD_HASH_SLOT(Slot, TokenName) slots[Slot] = TokenKindRawEnum::TokenName;
+            #include "lexer/token_kind.def"
+            return slots;
+        }();
+    } // namespace detail
+
     struct TokenKind: public DARK_ENUM_BASE(TokenKind) {
         #define DARK_TOKEN(TokenName, SnakeCaseName) DARK_ENUM_CONSTANT_DECL(TokenName)
         #include "lexer/token_kind.def"
@@ -23,6 +67,9 @@ namespace dark::lexer {
 
         static const llvm::ArrayRef<TokenKind> keyword_tokens;
 
+        // Returns the keyword spelled `text`, or `Error` if there is none.
+        [[nodiscard]] static constexpr auto from_keyword_spelling(llvm::StringRef text) noexcept -> TokenKind;
+
         [[nodiscard]] constexpr auto is_symbol() const noexcept -> bool { 
             switch (DARK_CAST_RAW_ENUM(TokenKind, (as_int()))) {
                 #define DARK_SYMBOL_TOKEN(TokenName, Spelling, SnakeCaseName) case DARK_RAW_ENUM_VALUE(TokenKind, TokenName): return true;
@@ -92,15 +139,21 @@ namespace dark::lexer {
             }
         }
         
-        auto opening_symbol() const noexcept -> bool { 
-            auto result = is_opening_symbol();
-            dark_assert(result, "TokenKind is not an opening symbol");
-            return result;
+        [[nodiscard]] constexpr auto opening_symbol() const noexcept -> TokenKind { 
+            switch (DARK_CAST_RAW_ENUM(TokenKind, (as_int()))) {
+                #define DARK_CLOSING_GROUP_SYMBOL_TOKEN(TokenName, Spelling, OpeningName, SnakeCaseName) case DARK_RAW_ENUM_VALUE(TokenKind, TokenName): return Make(DARK_RAW_ENUM_VALUE(TokenKind, OpeningName));
+                #include "lexer/token_kind.def"
+
+                default: dark_assert(false, "TokenKind is not a closing symbol"); std::unreachable();
+            }
         }
-        auto closing_symbol() const noexcept -> bool { 
-            auto result = is_closing_symbol();
-            dark_assert(result, "TokenKind is not a closing symbol");
-            return result;
+        [[nodiscard]] constexpr auto closing_symbol() const noexcept -> TokenKind { 
+            switch (DARK_CAST_RAW_ENUM(TokenKind, (as_int()))) {
+                #define DARK_OPENING_GROUP_SYMBOL_TOKEN(TokenName, Spelling, ClosingName, SnakeCaseName) case DARK_RAW_ENUM_VALUE(TokenKind, TokenName): return Make(DARK_RAW_ENUM_VALUE(TokenKind, ClosingName));
+                #include "lexer/token_kind.def"
+
+                default: dark_assert(false, "TokenKind is not an opening symbol"); std::unreachable();
+            }
         }
 
         constexpr auto is_sized_type_literal() const noexcept -> bool {
@@ -143,6 +196,12 @@ namespace dark::lexer {
 
     constexpr llvm::ArrayRef<TokenKind> TokenKind::keyword_tokens = s_keyword_tokens_storage;
 
+    constexpr auto TokenKind::from_keyword_spelling(llvm::StringRef text) noexcept -> TokenKind {
+        if (text.empty()) return TokenKind::Error;
+        auto const kind = Make(detail::keyword_hash_slots[detail::keyword_hash.slot(text)]);
+        return kind.fixed_spelling() == text ? kind : TokenKind::Error;
+    }
+
 
 } // namespace dark::lexer
 
@@ -0,0 +1,232 @@
+#ifndef __DARK_LEXER_TOKEN_SNAPSHOT_HPP__
+#define __DARK_LEXER_TOKEN_SNAPSHOT_HPP__
+
+#include "base/index_base.hpp"
+#include "base/value_store.hpp"
+#include "lexer/token_buffer.hpp"
+#include "lexer/token_kind.hpp"
+#include "source/line_table.hpp"
+#include "source/source_buffer.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/BitVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace dark::lexer {
+
+    // A binary image of a lexed file: its tokens, its line starts and the
+    // strings, integers and reals its tokens refer to. Values are renumbered
+    // into tables of the snapshot's own, in the order lexing first met them, so
+    // a snapshot does not depend on the stores it was taken from.
+    //
+    // The image is little-endian with every array aligned to 8 bytes, so the
+    // accessors read a mapped snapshot in place. Opening validates every
+    // section and entry once, and `load` copies the arrays into a token buffer
+    // of its own, walking only the payloads to renumber their values. A
+    // snapshot records the content hash of its source and only opens against a
+    // source with the same hash.
+    struct TokenSnapshot {
+        static constexpr auto version = std::uint32_t{ 2 };
+        static constexpr llvm::StringLiteral extension = ".dtok";
+
+        TokenSnapshot(TokenSnapshot const&) = delete;
+        TokenSnapshot(TokenSnapshot&&) noexcept = default;
+        TokenSnapshot& operator=(TokenSnapshot const&) = delete;
+        TokenSnapshot& operator=(TokenSnapshot&&) noexcept = default;
+        ~TokenSnapshot() = default;
+
+        [[nodiscard]] static auto hash_source(SourceBuffer const& source) noexcept -> std::uint64_t;
+
+        // `<hash><extension>`, the name a cache keyed by content would use.
+        [[nodiscard]] static auto get_filename(SourceBuffer const& source) -> std::string;
+        [[nodiscard]] static auto get_filename(std::uint64_t source_hash) -> std::string;
+
+        // Returns the image of `tokens`, or nothing on a big-endian host.
+        // Overloads taking `source_hash` expect `hash_source` of the tokens'
+        // source, for callers that already computed it.
+        [[nodiscard]] static auto serialize(TokenizedBuffer const& tokens) -> std::optional<std::string>;
+        [[nodiscard]] static auto serialize(TokenizedBuffer const& tokens, std::uint64_t source_hash) -> std::optional<std::string>;
+
+        // Writes through a temporary file, so concurrent writers and readers of
+        // the same snapshot never see a partial one.
+        static auto write(TokenizedBuffer const& tokens, llvm::StringRef filename) -> bool;
+        static auto write(TokenizedBuffer const& tokens, llvm::StringRef filename, std::uint64_t source_hash) -> bool;
+
+        // Returns nothing if the file cannot be read, was written by another
+        // version or with another id width, is malformed, or was taken of a
+        // source other than `source`.
+        [[nodiscard]] static auto open(llvm::StringRef filename, SourceBuffer const& source) -> std::optional<TokenSnapshot>;
+        [[nodiscard]] static auto open(llvm::StringRef filename, SourceBuffer const& source, std::uint64_t source_hash) -> std::optional<TokenSnapshot>;
+        [[nodiscard]] static auto open(std::unique_ptr<llvm::MemoryBuffer> buffer, SourceBuffer const& source) -> std::optional<TokenSnapshot>;
+        [[nodiscard]] static auto open(std::unique_ptr<llvm::MemoryBuffer> buffer, SourceBuffer const& source, std::uint64_t source_hash) -> std::optional<TokenSnapshot>;
+
+        // Builds the token buffer the lexer would have produced, interning the
+        // values into `value_stores` in the same order and seeding the source's
+        // line table. Lexer diagnostics are not part of a snapshot.
+        [[nodiscard]] auto load(SourceBuffer& source, SharedValueStores& value_stores) const -> TokenizedBuffer;
+
+        [[nodiscard]] auto size() const noexcept -> std::size_t { return get_kinds().size(); }
+
+        [[nodiscard]] auto get_kinds() const noexcept -> llvm::ArrayRef<TokenKind> {
+            return get_section<TokenKind>(Section::Kinds);
+        }
+
+        [[nodiscard]] auto get_offsets() const noexcept -> llvm::ArrayRef<TokenizedBuffer::offset_type> {
+            return get_section<TokenizedBuffer::offset_type>(Section::Offsets);
+        }
+
+        [[nodiscard]] auto get_lengths() const noexcept -> llvm::ArrayRef<TokenizedBuffer::offset_type> {
+            return get_section<TokenizedBuffer::offset_type>(Section::Lengths);
+        }
+
+        // Raw payloads; value ids index the snapshot's tables below and token
+        // ids are unchanged.
+        [[nodiscard]] auto get_payloads() const noexcept -> llvm::ArrayRef<IdBase::inner_type> {
+            return get_section<IdBase::inner_type>(Section::Payloads);
+        }
+
+        [[nodiscard]] auto has_trailing_whitespace(TokenIndex token) const noexcept -> bool {
+            return test_bit(Section::TrailingSpace, static_cast<std::size_t>(token));
+        }
+
+        [[nodiscard]] auto is_recovery_token(TokenIndex token) const noexcept -> bool {
+            return test_bit(Section::Recovery, static_cast<std::size_t>(token));
+        }
+
+        [[nodiscard]] auto get_line_starts() const noexcept -> llvm::ArrayRef<LineTable::offset_type> {
+            return get_section<LineTable::offset_type>(Section::LineStarts);
+        }
+
+        [[nodiscard]] auto string_count() const noexcept -> std::size_t {
+            return get_section<StringEntry>(Section::Strings).size();
+        }
+
+        // Strings that were slices of the source point into it; the others
+        // point into the snapshot.
+        [[nodiscard]] auto get_string(std::size_t index) const noexcept -> std::string_view;
+
+        [[nodiscard]] auto int_count() const noexcept -> std::size_t {
+            return get_section<IntEntry>(Section::Ints).size();
+        }
+
+        [[nodiscard]] auto get_int(std::size_t index) const -> llvm::APInt;
+
+        [[nodiscard]] auto real_count() const noexcept -> std::size_t {
+            return get_section<RealEntry>(Section::Reals).size();
+        }
+
+        [[nodiscard]] auto get_real(std::size_t index) const -> Real;
+
+        // Reals stored as a `double` have their own table; their payloads are
+        // `RealId::make_double` of an index into it.
+        [[nodiscard]] auto double_count() const noexcept -> std::size_t {
+            return get_doubles().size();
+        }
+
+        [[nodiscard]] auto get_doubles() const noexcept -> llvm::ArrayRef<double> {
+            return get_section<double>(Section::Doubles);
+        }
+
+        [[nodiscard]] auto has_error() const noexcept -> bool { return m_header.has_errors != 0; }
+
+    private:
+        enum class Section: std::uint8_t {
+            Kinds,
+            TrailingSpace,
+            Recovery,
+            Offsets,
+            Lengths,
+            Payloads,
+            LineStarts,
+            Strings,
+            StringBytes,
+            Ints,
+            Reals,
+            IntWords,
+            Doubles,
+            Count
+        };
+
+        static constexpr auto section_count = static_cast<std::size_t>(Section::Count);
+
+        // Byte range of a section, relative to the start of the image.
+        struct SectionRange {
+            std::uint64_t offset;
+            std::uint64_t size;
+        };
+
+        struct Header {
+            std::array<char, 8> magic;
+            std::uint32_t version;
+            // `sizeof(IdBase::inner_type)`, which also fixes the width of offsets.
+            std::uint32_t id_size;
+            std::uint64_t source_hash;
+            std::uint64_t source_size;
+            std::int64_t expected_parse_tree_size;
+            std::uint64_t has_errors;
+            std::array<SectionRange, section_count> sections;
+        };
+
+        struct StringEntry {
+            std::uint64_t offset;
+            std::uint32_t length;
+            // Zero if `offset` is into the source, one if into `StringBytes`.
+            std::uint32_t is_owned;
+        };
+
+        // The limbs of an `APInt`, in `IntWords`.
+        struct IntEntry {
+            std::uint32_t bit_width;
+            std::uint32_t word_count;
+            std::uint64_t word_offset;
+        };
+
+        struct RealEntry {
+            IntEntry mantissa;
+            IntEntry exponent;
+            std::uint64_t is_decimal;
+        };
+
+        struct Writer;
+
+        TokenSnapshot(std::unique_ptr<llvm::MemoryBuffer> buffer, Header const& header, SourceBuffer const& source)
+            : m_buffer(std::move(buffer))
+            , m_header(header)
+            , m_source(&source)
+        {
+        }
+
+        [[nodiscard]] auto validate() const -> bool;
+
+        template <typename T>
+        [[nodiscard]] auto get_section(Section section) const noexcept -> llvm::ArrayRef<T> {
+            auto const& range = m_header.sections[static_cast<std::size_t>(section)];
+            return { reinterpret_cast<T const*>(m_buffer->getBufferStart() + range.offset), static_cast<std::size_t>(range.size / sizeof(T)) };
+        }
+
+        [[nodiscard]] auto test_bit(Section section, std::size_t index) const noexcept -> bool {
+            return (get_section<std::uint64_t>(section)[index / 64] >> (index % 64)) & 1;
+        }
+
+        // Copies a bit section into `bits` a word at a time.
+        auto load_bits(Section section, llvm::BitVector& bits) const -> void;
+
+        [[nodiscard]] auto make_apint(IntEntry const& entry) const -> llvm::APInt;
+
+    private:
+        std::unique_ptr<llvm::MemoryBuffer> m_buffer;
+        Header m_header;
+        SourceBuffer const* m_source;
+    };
+
+} // namespace dark::lexer
+
+#endif // __DARK_LEXER_TOKEN_SNAPSHOT_HPP__
@@ -0,0 +1,83 @@
+#ifndef __DARK_SOURCE_LINE_TABLE_HPP__
+#define __DARK_SOURCE_LINE_TABLE_HPP__
+
+#include "base/index_base.hpp"
+#include <atomic>
+#include <cstddef>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <type_traits>
+
+namespace dark {
+
+    // Start offsets of every line in a source, used to turn byte offsets into
+    // line/column pairs.
+    struct LineTable {
+        using offset_type = std::make_unsigned_t<IdBase::inner_type>;
+
+        // Both are zero-based.
+        struct Location {
+            offset_type line;
+            offset_type column;
+        };
+
+        LineTable() noexcept = default;
+        explicit LineTable(llvm::StringRef source);
+
+        // `line_starts` must start with zero and be sorted, as `get_line_starts`
+        // returns them.
+        [[nodiscard]] static auto from_line_starts(llvm::ArrayRef<offset_type> line_starts) -> LineTable {
+            auto table = LineTable();
+            table.m_line_starts.assign(line_starts.begin(), line_starts.end());
+            return table;
+        }
+
+        LineTable(LineTable const& other)
+            : m_line_starts(other.m_line_starts)
+            , m_last_line(other.m_last_line.load(std::memory_order_relaxed))
+        {}
+        LineTable(LineTable&& other) noexcept
+            : m_line_starts(std::move(other.m_line_starts))
+            , m_last_line(other.m_last_line.load(std::memory_order_relaxed))
+        {}
+        LineTable& operator=(LineTable const& other) {
+            m_line_starts = other.m_line_starts;
+            m_last_line.store(other.m_last_line.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            return *this;
+        }
+        LineTable& operator=(LineTable&& other) noexcept {
+            m_line_starts = std::move(other.m_line_starts);
+            m_last_line.store(other.m_last_line.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            return *this;
+        }
+        ~LineTable() = default;
+
+        // Offsets past the end of the source resolve to the last line.
+        [[nodiscard]] auto lookup(offset_type offset) const noexcept -> Location;
+
+        [[nodiscard]] auto get_line_start(offset_type line) const noexcept -> offset_type {
+            return m_line_starts[line];
+        }
+
+        // The text of `line` without its newline.
+        [[nodiscard]] auto get_line(llvm::StringRef source, offset_type line) const noexcept -> llvm::StringRef {
+            auto const start = m_line_starts[line];
+            auto const end = line + 1 < m_line_starts.size() ? m_line_starts[line + 1] - 1 : source.size();
+            return source.slice(start, end);
+        }
+
+        [[nodiscard]] auto size() const noexcept -> std::size_t { return m_line_starts.size(); }
+
+        [[nodiscard]] auto get_line_starts() const noexcept -> llvm::ArrayRef<offset_type> { return m_line_starts; }
+
+    private:
+        llvm::SmallVector<offset_type, 0> m_line_starts{ 0 };
+        // Diagnostics tend to arrive in source order, so the previous hit is a
+        // good guess for the next one.
+        mutable std::atomic<offset_type> m_last_line{ 0 };
+    };
+
+} // namespace dark
+
+#endif // __DARK_SOURCE_LINE_TABLE_HPP__
@@ -1,15 +1,33 @@
 #ifndef __DARK_SOURCE_SOURCE_BUFFER_HPP__
 #define __DARK_SOURCE_SOURCE_BUFFER_HPP__
 
+#include "common/utf8.hpp"
 #include "diagnostics/diagnostic_consumer.hpp"
+#include "source/line_table.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <llvm/ADT/StringRef.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/MemoryBuffer.h>
 #include <optional>
 #include <string>
 #include <memory>
+#include <mutex>
 namespace dark {
 
+    // Every source buffer is followed by at least `padding` zero bytes, so scanners
+    // may read a full vector past any position inside the source without checking
+    // the size first.
     struct SourceBuffer {
+        static constexpr std::size_t padding = 64;
+
+        enum class LoadMode: std::uint8_t {
+            // Maps the file when the mapping leaves enough zero-filled slack in
+            // its last page; otherwise falls back to `Buffered`.
+            Mapped,
+            // Reads the file into a padded heap buffer.
+            Buffered
+        };
 
         SourceBuffer() = delete;
         SourceBuffer(SourceBuffer const&) = delete;
@@ -21,7 +39,8 @@ namespace dark {
         static auto make_from_file(
             llvm::vfs::FileSystem& fs,
             llvm::StringRef filename,
-            DiagnosticConsumer& consumer
+            DiagnosticConsumer& consumer,
+            LoadMode mode = LoadMode::Mapped
         ) -> std::optional<SourceBuffer>;
 
         static auto make_from_stdin(
@@ -33,31 +52,73 @@ namespace dark {
         }
 
         constexpr auto get_source() const noexcept -> llvm::StringRef {
-            return m_source->getBuffer();
+            return m_text;
+        }
+
+        // The source followed by its zero padding.
+        [[nodiscard]] constexpr auto get_padded_source() const noexcept -> llvm::StringRef {
+            return { m_text.data(), m_text.size() + padding };
+        }
+
+        // Built on first use; safe to call from multiple threads.
+        [[nodiscard]] auto get_line_table() const -> LineTable const&;
+
+        // Supplies the line table instead of building it, e.g. from a cache. Has
+        // no effect once the table exists.
+        auto set_line_table(LineTable table) const -> void;
+
+        [[nodiscard]] constexpr auto is_mapped() const noexcept -> bool {
+            return m_source->getBufferKind() == llvm::MemoryBuffer::MemoryBuffer_MMap;
         }
 
         [[nodiscard]] constexpr auto is_regular_file() const noexcept -> bool {
             return m_is_regular_file;
         }
 
+        // Both are computed once when the buffer is loaded.
+        [[nodiscard]] constexpr auto is_ascii() const noexcept -> bool {
+            return m_is_ascii;
+        }
+
+        [[nodiscard]] constexpr auto is_valid_utf8() const noexcept -> bool {
+            return m_is_valid_utf8;
+        }
+
     private:
+        struct LazyLineTable {
+            std::once_flag once;
+            LineTable table;
+        };
+
         static auto make_from_memory_buffer(
             llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> buffer,
             llvm::StringRef filename,
             bool is_regular_file,
             DiagnosticConsumer& consumer
         ) -> std::optional<SourceBuffer>;
+
+        // Returns the buffer unchanged if it is already followed by `padding` zero
+        // bytes; otherwise copies it into a padded heap buffer.
+        static auto ensure_padding(std::unique_ptr<llvm::MemoryBuffer> buffer) -> std::unique_ptr<llvm::MemoryBuffer>;
         
-        explicit SourceBuffer(std::string filename, std::unique_ptr<llvm::MemoryBuffer> source, bool is_regular_file)
+        explicit SourceBuffer(std::string filename, std::unique_ptr<llvm::MemoryBuffer> source, std::size_t size, bool is_regular_file)
             : m_filename(std::move(filename))
             , m_source(std::move(source))
+            , m_text(m_source->getBufferStart(), size)
+            , m_line_table(std::make_unique<LazyLineTable>())
             , m_is_regular_file(is_regular_file)
+            , m_is_ascii(utf8::is_string_ascii(m_text))
+            , m_is_valid_utf8(m_is_ascii || utf8::is_string_utf8(m_text))
         {}
 
     private:
         std::string m_filename;
         std::unique_ptr<llvm::MemoryBuffer> m_source;
+        llvm::StringRef m_text;
+        std::unique_ptr<LazyLineTable> m_line_table;
         bool m_is_regular_file;
+        bool m_is_ascii;
+        bool m_is_valid_utf8;
     };
 
 } // namespace dark
@@ -0,0 +1,198 @@
+#include "common/real_conversion.hpp"
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <llvm/ADT/APFloat.h>
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Error.h>
+#include <optional>
+
+namespace dark {
+
+    namespace detail {
+        #include "common/power_of_five.def"
+    } // namespace detail
+
+    namespace {
+        constexpr auto mantissa_explicit_bits = 52;
+        constexpr auto minimum_exponent = -1023;
+        constexpr auto infinite_power = 0x7FF;
+
+        // Exact ties need `5^q < 2^64` for positive powers and `5^-q` to divide
+        // the mantissa for negative ones, which confines them to this range.
+        constexpr auto min_exponent_round_to_even = -4;
+        constexpr auto max_exponent_round_to_even = 23;
+
+        struct Product {
+            std::uint64_t high;
+            std::uint64_t low;
+        };
+
+        inline auto multiply(std::uint64_t lhs, std::uint64_t rhs) noexcept -> Product {
+            auto const product = static_cast<unsigned __int128>(lhs) * rhs;
+            return { .high = static_cast<std::uint64_t>(product >> 64), .low = static_cast<std::uint64_t>(product) };
+        }
+
+        // `floor(log2(10^q)) + 63` over the range of the table.
+        constexpr auto get_binary_power(std::int64_t q) noexcept -> std::int64_t {
+            return (((152170 + 65536) * q) >> 16) + 63;
+        }
+
+        inline auto make_double(std::uint64_t mantissa, std::int64_t power2) noexcept -> double {
+            return std::bit_cast<double>(mantissa | (static_cast<std::uint64_t>(power2) << mantissa_explicit_bits));
+        }
+
+        // Eisel-Lemire; see Lemire, "Number Parsing at a Gigabyte per Second".
+        // Returns nothing in the rare case that the truncated product cannot
+        // decide the rounding.
+        auto eisel_lemire(std::uint64_t w, std::int64_t q) noexcept -> std::optional<double> {
+            if (w == 0 || q < detail::smallest_power_of_five) return 0.0;
+            if (q > detail::largest_power_of_five) return std::numeric_limits<double>::infinity();
+
+            auto const leading_zeros = std::countl_zero(w);
+            w <<= leading_zeros;
+
+            // Only the top `mantissa_explicit_bits + 3` bits of the product are
+            // needed, so the low word of the power is used only if they could
+            // still change.
+            constexpr auto precision_mask = ~std::uint64_t{} >> (mantissa_explicit_bits + 3);
+            auto const index = static_cast<std::size_t>(2 * (q - detail::smallest_power_of_five));
+            auto product = multiply(w, detail::power_of_five_128[index]);
+            if ((product.high & precision_mask) == precision_mask) {
+                auto const second = multiply(w, detail::power_of_five_128[index + 1]);
+                product.low += second.high;
+                if (second.high > product.low) ++product.high;
+            }
+
+            // Outside this range the table entry is inexact and a saturated low word
+            // may hide a carry.
+            if (product.low == ~std::uint64_t{} && (q < -27 || q > 55)) return std::nullopt;
+
+            auto const upper_bit = static_cast<int>(product.high >> 63);
+            auto const shift = upper_bit + 64 - mantissa_explicit_bits - 3;
+            auto mantissa = product.high >> shift;
+            auto power2 = get_binary_power(q) + upper_bit - leading_zeros - minimum_exponent;
+
+            if (power2 <= 0) {
+                // Subnormal, or zero once shifted past the last bit.
+                if (-power2 + 1 >= 64) return 0.0;
+                mantissa >>= -power2 + 1;
+                mantissa += mantissa & 1;
+                mantissa >>= 1;
+                power2 = mantissa < (std::uint64_t{ 1 } << mantissa_explicit_bits) ? 0 : 1;
+                return make_double(mantissa, power2);
+            }
+
+            // A product that is exactly halfway must round to even rather than up.
+            if (product.low <= 1 && q >= min_exponent_round_to_even && q <= max_exponent_round_to_even && (mantissa & 3) == 1) {
+                if ((mantissa << shift) == product.high) mantissa &= ~std::uint64_t{ 1 };
+            }
+
+            mantissa += mantissa & 1;
+            mantissa >>= 1;
+            if (mantissa >= (std::uint64_t{ 2 } << mantissa_explicit_bits)) {
+                mantissa = std::uint64_t{ 1 } << mantissa_explicit_bits;
+                ++power2;
+            }
+
+            mantissa &= ~(std::uint64_t{ 1 } << mantissa_explicit_bits);
+            if (power2 >= infinite_power) return std::numeric_limits<double>::infinity();
+            return make_double(mantissa, power2);
+        }
+
+        // The slow path: `llvm::APFloat` rounds any decimal or hexadecimal
+        // spelling correctly.
+        auto parse_double(llvm::StringRef text) -> double {
+            auto value = llvm::APFloat(llvm::APFloat::IEEEdouble());
+            auto status = value.convertFromString(text, llvm::APFloat::rmNearestTiesToEven);
+            if (!status) {
+                llvm::consumeError(status.takeError());
+                return std::numeric_limits<double>::quiet_NaN();
+            }
+            return value.convertToDouble();
+        }
+
+        // `5^exponent` if it fits in 64 bits.
+        constexpr auto power_of_five(std::int64_t exponent) noexcept -> std::optional<std::uint64_t> {
+            auto result = std::uint64_t{ 1 };
+            for (auto i = std::int64_t{}; i < exponent; ++i) {
+                if (__builtin_mul_overflow(result, std::uint64_t{ 5 }, &result)) return std::nullopt;
+            }
+            return result;
+        }
+    } // namespace
+
+    auto decimal_to_double(std::uint64_t mantissa, std::int64_t exponent) -> double {
+        if (auto value = eisel_lemire(mantissa, exponent)) return *value;
+
+        auto text = llvm::SmallString<48>();
+        llvm::APInt(64, mantissa).toString(text, 10, /*Signed=*/false);
+        text.push_back('e');
+        llvm::APInt(64, static_cast<std::uint64_t>(exponent), /*isSigned=*/true).toString(text, 10, /*Signed=*/true);
+        return parse_double(text);
+    }
+
+    auto decimal_to_double(llvm::APInt const& mantissa, llvm::APInt const& exponent) -> double {
+        if (mantissa.getActiveBits() <= 64 && exponent.getMinSignedBits() <= 64) {
+            return decimal_to_double(mantissa.getZExtValue(), exponent.getSExtValue());
+        }
+
+        auto text = llvm::SmallString<64>();
+        mantissa.toString(text, 10, /*Signed=*/false);
+        text.push_back('e');
+        exponent.toString(text, 10, /*Signed=*/true);
+        return parse_double(text);
+    }
+
+    auto binary_to_double(llvm::APInt const& mantissa, llvm::APInt const& exponent) -> double {
+        if (mantissa.getActiveBits() <= 64 && exponent.getMinSignedBits() <= 64) {
+            if (auto value = exact_binary_to_double(mantissa.getZExtValue(), exponent.getSExtValue())) return *value;
+        }
+
+        auto text = llvm::SmallString<64>("0x");
+        mantissa.toString(text, 16, /*Signed=*/false);
+        text.push_back('p');
+        exponent.toString(text, 10, /*Signed=*/true);
+        return parse_double(text);
+    }
+
+    auto exact_decimal_to_double(std::uint64_t mantissa, std::int64_t exponent) -> std::optional<double> {
+        if (mantissa == 0) return 0.0;
+
+        // `m * 10^q` is `m * 5^q * 2^q`, so it is a double exactly when the odd
+        // part of `m * 5^q` fits in the significand. For a negative `q`, `5^-q`
+        // must divide `m`, which bounds `q` by the width of `m`.
+        auto odd = mantissa >> std::countr_zero(mantissa);
+        if (exponent >= 0) {
+            auto const scale = power_of_five(exponent);
+            if (!scale || __builtin_mul_overflow(odd, *scale, &odd)) return std::nullopt;
+        } else {
+            auto const divisor = exponent < -27 ? std::nullopt : power_of_five(-exponent);
+            if (!divisor || odd % *divisor != 0) return std::nullopt;
+            odd /= *divisor;
+        }
+
+        if (std::bit_width(odd) > mantissa_explicit_bits + 1) return std::nullopt;
+        return decimal_to_double(mantissa, exponent);
+    }
+
+    auto exact_binary_to_double(std::uint64_t mantissa, std::int64_t exponent) noexcept -> std::optional<double> {
+        if (mantissa == 0) return 0.0;
+
+        auto const trailing_zeros = std::countr_zero(mantissa);
+        auto const odd = mantissa >> trailing_zeros;
+        if (std::bit_width(odd) > mantissa_explicit_bits + 1) return std::nullopt;
+        if (__builtin_add_overflow(exponent, std::int64_t{ trailing_zeros }, &exponent)) return std::nullopt;
+
+        // The lowest bit must be at or above the smallest subnormal and the
+        // highest below the overflow threshold.
+        auto const width = static_cast<std::int64_t>(std::bit_width(odd));
+        if (exponent < -1074 || exponent > 1024 - width) return std::nullopt;
+        return std::ldexp(static_cast<double>(odd), static_cast<int>(exponent));
+    }
+
+} // namespace dark
@@ -0,0 +1,965 @@
+#include "lexer/lexer.hpp"
+#include "common/assert.hpp"
+#include "common/bit_array.hpp"
+#include "common/string_utils.hpp"
+#include "common/utf8.hpp"
+#include "lexer/character_set.hpp"
+#include "lexer/numeric_literal.hpp"
+#include "lexer/string_literal.hpp"
+#include "lexer/token_kind.hpp"
+#include "lexer/token_snapshot.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <llvm/ADT/ArrayRef.h>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Path.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/Threading.h>
+#include <memory>
+#include <optional>
+#include <string_view>
+#include <variant>
+
+#if defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+namespace dark::lexer {
+
+    namespace {
+        constexpr auto identifier_start_chars = []() {
+            auto res = BitArray<256>();
+            for (auto c = 0u; c < 26u; ++c) {
+                res[static_cast<unsigned>('a') + c] = true;
+                res[static_cast<unsigned>('A') + c] = true;
+            }
+            res[static_cast<unsigned>('_')] = true;
+            return res;
+        }();
+
+        // Longest-match automaton over every `DARK_SYMBOL_TOKEN` spelling. Bytes are
+        // first mapped to a class so each state only needs a row as wide as the
+        // number of distinct symbol bytes. Class zero and state zero never appear as
+        // transition targets, so a zero entry means "no transition".
+        struct SymbolDfa {
+            static constexpr auto spelling_bytes = std::size_t{ 0
+                #define DARK_SYMBOL_TOKEN(TokenName, Spelling, SnakeCaseName) + (sizeof(Spelling) - 1)
+                #include "lexer/token_kind.def"
+            };
+
+            static constexpr auto byte_classes = []() {
+                auto classes = std::array<std::uint8_t, 256>{};
+                auto next = std::uint8_t{ 1 };
+                auto const add = [&](std::string_view spelling) {
+                    for (auto c: spelling) {
+                        auto& entry = classes[static_cast<unsigned char>(c)];
+                        if (entry == 0) entry = next++;
+                    }
+                };
+                #define DARK_SYMBOL_TOKEN(TokenName, Spelling, SnakeCaseName) add(Spelling);
+                #include "lexer/token_kind.def"
+                return classes;
+            }();
+
+            static constexpr auto class_count = static_cast<std::size_t>(*std::max_element(byte_classes.begin(), byte_classes.end())) + 1;
+            // Every byte of every spelling adds at most one state to the root.
+            static constexpr auto state_count = spelling_bytes + 1;
+            static_assert(state_count <= 256, "Symbol spellings no longer fit in 8-bit DFA states");
+
+            std::array<std::array<std::uint8_t, class_count>, state_count> transitions{};
+            std::array<detail::TokenKindRawEnum, state_count> accepts{};
+
+            [[nodiscard]] static constexpr auto make() -> SymbolDfa {
+                auto dfa = SymbolDfa{};
+                auto states = std::size_t{ 1 };
+                auto const add = [&](std::string_view spelling, TokenKind kind) {
+                    auto state = std::size_t{};
+                    for (auto c: spelling) {
+                        auto& next = dfa.transitions[state][byte_classes[static_cast<unsigned char>(c)]];
+                        if (next == 0) next = static_cast<std::uint8_t>(states++);
+                        state = next;
+                    }
+                    dfa.accepts[state] = kind;
+                };
+                #define DARK_SYMBOL_TOKEN(TokenName, Spelling, SnakeCaseName) add(Spelling, TokenKind::TokenName);
+                #include "lexer/token_kind.def"
+                return dfa;
+            }
+
+            // Walks forward once, remembering the last accepting state. The source
+            // padding ends the walk since '\0' belongs to no spelling.
+            [[nodiscard]] constexpr auto match(char const* it) const noexcept -> TokenKind {
+                auto state = std::size_t{};
+                auto result = detail::TokenKindRawEnum{};
+                while (true) {
+                    auto const next = transitions[state][byte_classes[static_cast<unsigned char>(*it++)]];
+                    if (next == 0) break;
+                    state = next;
+                    if (accepts[state] != detail::TokenKindRawEnum{}) result = accepts[state];
+                }
+                return TokenKind::Make(result);
+            }
+        };
+
+        constexpr auto symbol_dfa = SymbolDfa::make();
+
+        // Loads may run past the end of the source, but never past its padding, and
+        // the zero padding always stops the scan.
+        [[nodiscard]] inline auto skip_horizontal_whitespace(char const* it) noexcept -> char const* {
+        #if defined(__SSE2__)
+            auto const space = _mm_set1_epi8(' ');
+            auto const tab = _mm_set1_epi8('\t');
+            auto const carriage_return = _mm_set1_epi8('\r');
+            while (true) {
+                auto const chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(it));
+                auto const is_space = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(chunk, space), _mm_cmpeq_epi8(chunk, tab)),
+                    _mm_cmpeq_epi8(chunk, carriage_return)
+                );
+                auto const mask = static_cast<unsigned>(_mm_movemask_epi8(is_space)) ^ 0xFFFFu;
+                if (mask != 0) return it + std::countr_zero(mask);
+                it += 16;
+            }
+        #else
+            while (*it == ' ' || *it == '\t' || *it == '\r') ++it;
+            return it;
+        #endif
+        }
+
+        // Holds the diagnostics of a parallel lexing segment until the merge
+        // knows where they belong. `position` is where the lexer was dispatched
+        // when the diagnostic was emitted.
+        struct SegmentDiagnosticConsumer: DiagnosticConsumer {
+            struct Entry {
+                std::size_t position;
+                Diagnostic diagnostic;
+            };
+
+            explicit SegmentDiagnosticConsumer(std::size_t const* position) noexcept
+                : m_position(position)
+            {
+            }
+
+            auto consume(Diagnostic&& diagnostic) -> void override {
+                entries.push_back({ .position = *m_position, .diagnostic = std::move(diagnostic) });
+            }
+
+            llvm::SmallVector<Entry, 0> entries;
+        private:
+            std::size_t const* m_position;
+        };
+    } // namespace
+
+    template <bool AsciiOnly>
+    struct Lexer::Impl {
+        using DispatchFunction = auto(Impl&, llvm::StringRef, std::size_t&) -> void;
+        using offset_type = TokenizedBuffer::offset_type;
+
+        Impl(SharedValueStores& value_stores, SourceBuffer& source, DiagnosticConsumer& consumer, LiteralMode literal_mode = LiteralMode::Eager)
+            : m_buffer(value_stores, source)
+            , m_consumer(&consumer)
+            , m_converter(&m_buffer)
+            , m_emitter(m_converter, m_consumer)
+            , m_lazy_literals(literal_mode != LiteralMode::Eager)
+            , m_defer_identifiers(literal_mode == LiteralMode::Batch)
+        {
+            if (literal_mode == LiteralMode::Lazy) m_buffer.m_lazy = std::make_unique<TokenizedBuffer::LazyLiterals>();
+        }
+
+        Impl(Impl const&) = delete;
+        Impl(Impl&&) = delete;
+        Impl& operator=(Impl const&) = delete;
+        Impl& operator=(Impl&&) = delete;
+        ~Impl() = default;
+
+        auto lex() && -> TokenizedBuffer {
+            [[maybe_unused]] auto _ = add_token(TokenKind::FileStart, 0, 0);
+            lex_range(0, m_buffer.m_source->get_source().size());
+            return std::move(*this).finish();
+        }
+
+        // Lexes `boundaries.size() - 1` newline-aligned chunks concurrently and
+        // stitches them together in source order.
+        [[nodiscard]] static auto lex_chunks(
+            SourceBuffer& source,
+            SharedValueStores& value_stores,
+            DiagnosticConsumer& consumer,
+            llvm::ArrayRef<std::size_t> boundaries,
+            unsigned thread_count,
+            LiteralMode literal_mode
+        ) -> TokenizedBuffer;
+
+        struct Deferred;
+
+    private:
+        struct Segment;
+
+        // Returns the position lexing stopped at, which is past `end` when the
+        // last token runs over it.
+        auto lex_range(std::size_t begin, std::size_t end) -> std::size_t {
+            auto const source = m_buffer.m_source->get_source();
+            auto position = begin;
+            while (position < end) {
+                m_dispatch_position = position;
+                auto const c = static_cast<unsigned char>(source[position]);
+                s_dispatch_table[c](*this, source, position);
+            }
+            return position;
+        }
+
+        auto finish() && -> TokenizedBuffer {
+            // What the end of the file reports comes after every literal.
+            m_dispatch_position = m_buffer.m_source->get_source().size();
+            lex_file_end(m_buffer.m_source->get_source(), m_buffer.m_source->get_source().size());
+            m_buffer.m_has_errors = m_consumer.seen_error();
+            return std::move(m_buffer);
+        }
+
+        auto append_segment(Impl& segment, SegmentDiagnosticConsumer& diagnostics) -> void;
+
+        // Only used to reject comments that follow a token on the same line.
+        auto note_token_on_line() noexcept -> void {
+            m_line_has_token = true;
+        }
+
+        auto note_whitespace() noexcept -> void {
+            // Only a segment can start without a token; its whitespace belongs to
+            // the previous segment's last token.
+            if (m_buffer.size() == 0) {
+                m_has_leading_space = true;
+                return;
+            }
+            m_buffer.set_trailing_space(TokenIndex(m_buffer.size() - 1));
+        }
+
+        [[nodiscard]] auto add_token(TokenKind kind, std::size_t position, std::size_t length, bool is_recovery = false) -> TokenIndex {
+            return m_buffer.add_token({
+                .kind = kind,
+                .is_recovery = is_recovery,
+                .offset = static_cast<offset_type>(position),
+                .length = static_cast<offset_type>(length)
+            });
+        }
+
+        auto add_error_token(std::size_t position, std::size_t length) -> void {
+            note_token_on_line();
+            [[maybe_unused]] auto _ = add_token(TokenKind::Error, position, length);
+        }
+
+        auto lex_horizontal_whitespace(llvm::StringRef source, std::size_t& position) -> void {
+            note_whitespace();
+            auto const start = source.data();
+            position = static_cast<std::size_t>(skip_horizontal_whitespace(start + position + 1) - start);
+        }
+
+        auto lex_vertical_whitespace(llvm::StringRef, std::size_t& position) -> void {
+            note_whitespace();
+            m_line_has_token = false;
+            ++position;
+        }
+
+        auto lex_comment_or_error(llvm::StringRef source, std::size_t& position) -> void {
+            if (!source.substr(position).starts_with("//")) {
+                lex_error(source, position);
+                return;
+            }
+
+            if (position + 2 < source.size() && !char_set::is_space(source[position + 2])) {
+                DARK_DIAGNOSTIC(NoWhitespaceAfterCommentIntroducer, Error, "Whitespace is required after '//'.");
+                m_emitter.emit(source.begin() + position + 2, NoWhitespaceAfterCommentIntroducer);
+            }
+
+            if (m_line_has_token) {
+                DARK_DIAGNOSTIC(TrailingComment, Error, "Trailing comments are not permitted.");
+                m_emitter.emit(source.begin() + position, TrailingComment);
+            }
+
+            note_whitespace();
+            auto const end = source.find('\n', position + 2);
+            position = (end == llvm::StringRef::npos ? source.size() : end);
+        }
+
+        auto lex_numeric_literal(llvm::StringRef source, std::size_t& position) -> void {
+            auto literal = NumericLiteral::lex(source.substr(position));
+            if (!literal) {
+                lex_error(source, position);
+                return;
+            }
+
+            auto const size = literal->get_source().size();
+            note_token_on_line();
+
+            // A literal whose value cannot be computed becomes an error token.
+            auto const kind = literal->is_integer() ? TokenKind::IntegerLiteral : TokenKind::RealLiteral;
+            if (m_lazy_literals) {
+                m_buffer.mark_pending(add_token(kind, position, size));
+            } else {
+                auto value = literal->compute_value(m_emitter);
+                auto const token = add_token(kind, position, size);
+                if (!m_buffer.set_literal_value(token, std::move(value))) m_buffer.set_literal_error(token);
+            }
+
+            position += size;
+        }
+
+        auto lex_string_literal_or_hash(llvm::StringRef source, std::size_t& position) -> void {
+            auto literal = StringLiteral::lex(source.substr(position));
+            if (!literal) {
+                if (source[position] == '#') {
+                    lex_symbol(source, position);
+                } else {
+                    lex_error(source, position);
+                }
+                return;
+            }
+
+            auto const text = literal->get_source();
+            note_token_on_line();
+            if (text.contains('\n')) m_line_has_token = false;
+
+            if (!literal->is_terminated()) {
+                DARK_DIAGNOSTIC(UnterminatedString, Error, "String is missing a terminator.");
+                m_emitter.emit(text.begin(), UnterminatedString);
+                [[maybe_unused]] auto _ = add_token(TokenKind::Error, position, text.size());
+            } else if (m_lazy_literals) {
+                m_buffer.mark_pending(add_token(TokenKind::StringLiteral, position, text.size()));
+            } else {
+                auto value = literal->compute_value(m_buffer.m_allocator, m_emitter);
+                [[maybe_unused]] auto _ = m_buffer.set_literal_value(add_token(TokenKind::StringLiteral, position, text.size()), value);
+            }
+
+            position += text.size();
+        }
+
+        auto lex_word(llvm::StringRef source, std::size_t& position) -> void {
+            auto const start = position;
+
+            if constexpr (AsciiOnly) {
+                position += char_set::scan_ascii_identifier_continuation(source.substr(position));
+            } else {
+                auto cursor = utf8::Utf8Cursor(source, position);
+                if (!char_set::consume_identifier_start(cursor)) {
+                    auto const size = std::max<std::size_t>(1, std::min<std::size_t>(utf8::get_utf8_length(source[position]), source.size() - position));
+                    emit_unrecognized(source, position);
+                    add_error_token(position, size);
+                    position += size;
+                    return;
+                }
+                char_set::skip_identifier_continuation(cursor);
+                position = cursor.position();
+            }
+
+            auto const text = source.slice(start, position);
+            note_token_on_line();
+
+            if (auto kind = TokenKind::from_keyword_spelling(text); !kind.is_error()) {
+                [[maybe_unused]] auto _ = add_token(kind, start, text.size());
+                return;
+            }
+
+            // Identifiers share their store with string literals, so a batch
+            // interns both in token order.
+            if (m_defer_identifiers) {
+                m_buffer.mark_pending(add_token(TokenKind::Identifier, start, text.size()));
+                return;
+            }
+
+            // Hash while the identifier is still in cache; the interner probes
+            // with it directly.
+            auto const hash = StringInterner::hash(text);
+            auto token = add_token(TokenKind::Identifier, start, text.size());
+            m_buffer.get_payload(token).id = m_buffer.m_value_store->identifier().add_borrowed(text, hash);
+        }
+
+        auto lex_symbol(llvm::StringRef source, std::size_t& position) -> void {
+            auto const kind = symbol_dfa.match(source.data() + position);
+
+            if (kind.is_error()) {
+                lex_error(source, position);
+                return;
+            }
+
+            if (kind.is_opening_symbol()) {
+                lex_opening_symbol(kind, source, position);
+                return;
+            }
+
+            if (kind.is_closing_symbol()) {
+                lex_closing_symbol(kind, source, position);
+                return;
+            }
+
+            note_token_on_line();
+            [[maybe_unused]] auto _ = add_token(kind, position, kind.fixed_spelling().size());
+            position += kind.fixed_spelling().size();
+        }
+
+        auto lex_opening_symbol(TokenKind kind, llvm::StringRef, std::size_t& position) -> void {
+            note_token_on_line();
+            add_opening_symbol(kind, position);
+            position += kind.fixed_spelling().size();
+        }
+
+        auto lex_closing_symbol(TokenKind kind, llvm::StringRef source, std::size_t& position) -> void {
+            note_token_on_line();
+            add_closing_symbol(kind, source, position);
+            position += kind.fixed_spelling().size();
+        }
+
+        // Segments leave group matching to the merge since a group may span
+        // several of them.
+        auto add_opening_symbol(TokenKind kind, std::size_t position) -> void {
+            auto const token = add_token(kind, position, kind.fixed_spelling().size());
+            if (!m_is_segment) m_open_groups.push_back(token);
+        }
+
+        auto add_closing_symbol(TokenKind kind, llvm::StringRef source, std::size_t position) -> void {
+            if (m_is_segment) {
+                [[maybe_unused]] auto _ = add_token(kind, position, kind.fixed_spelling().size());
+                return;
+            }
+
+            close_invalid_open_groups(kind, source, position);
+
+            if (m_open_groups.empty()) {
+                DARK_DIAGNOSTIC(UnmatchedClosing, Error, "Closing symbol without a corresponding opening symbol.");
+                m_emitter.emit(source.begin() + position, UnmatchedClosing);
+                add_error_token(position, kind.fixed_spelling().size());
+                return;
+            }
+
+            auto const opening = m_open_groups.pop_back_val();
+            auto const closing = add_token(kind, position, kind.fixed_spelling().size());
+            m_buffer.get_payload(opening).close_paren = closing;
+            m_buffer.get_payload(closing).open_paren = opening;
+        }
+
+        // Closes every open group that `kind` cannot close by inserting recovery
+        // tokens, provided that some open group can be closed by `kind`.
+        auto close_invalid_open_groups(TokenKind kind, llvm::StringRef source, std::size_t position) -> void {
+            auto const can_close = std::any_of(m_open_groups.begin(), m_open_groups.end(), [this, kind](TokenIndex token) {
+                return m_buffer.get_kind(token).closing_symbol() == kind;
+            });
+
+            if (!can_close) return;
+
+            while (!m_open_groups.empty()) {
+                auto const opening = m_open_groups.back();
+                auto const opening_kind = m_buffer.get_kind(opening);
+                if (opening_kind.closing_symbol() == kind) return;
+
+                m_open_groups.pop_back();
+                DARK_DIAGNOSTIC(MismatchedClosing, Error, "Closing symbol does not match most recent opening symbol.");
+                m_emitter.emit(source.begin() + position, MismatchedClosing);
+                add_recovery_closing_token(opening, position);
+            }
+        }
+
+        auto add_recovery_closing_token(TokenIndex opening, std::size_t position) -> void {
+            auto const closing = add_token(m_buffer.get_kind(opening).closing_symbol(), position, 0, true);
+            m_buffer.get_payload(opening).close_paren = closing;
+            m_buffer.get_payload(closing).open_paren = opening;
+        }
+
+        auto lex_file_end(llvm::StringRef source, std::size_t position) -> void {
+            while (!m_open_groups.empty()) {
+                auto const opening = m_open_groups.pop_back_val();
+                DARK_DIAGNOSTIC(UnmatchedOpening, Error, "Opening symbol without a corresponding closing symbol.");
+                m_emitter.emit(source.begin() + m_buffer.get_token_offset(opening), UnmatchedOpening);
+                add_recovery_closing_token(opening, position);
+            }
+
+            [[maybe_unused]] auto _ = add_token(TokenKind::FileEnd, position, 0);
+        }
+
+        auto emit_unrecognized(llvm::StringRef source, std::size_t position) -> void {
+            DARK_DIAGNOSTIC(UnrecognizedCharacters, Error, "Encountered unrecognized characters while parsing.");
+            m_emitter.emit(source.begin() + position, UnrecognizedCharacters);
+        }
+
+        auto lex_error(llvm::StringRef source, std::size_t& position) -> void;
+
+        static constexpr auto make_dispatch_table() -> std::array<DispatchFunction*, 256>;
+
+    private:
+        static const std::array<DispatchFunction*, 256> s_dispatch_table;
+
+        TokenizedBuffer m_buffer;
+        ErrorTrackingDiagnosticConsumer m_consumer;
+        TokenizedBuffer::SourceBufferDiagnosticConverter m_converter;
+        LexerDiagnosticEmitter m_emitter;
+        bool m_line_has_token{ false };
+        llvm::SmallVector<TokenIndex> m_open_groups;
+        std::size_t m_dispatch_position{};
+        bool m_is_segment{ false };
+        bool m_has_leading_space{ false };
+        bool m_lazy_literals{ false };
+        bool m_defer_identifiers{ false };
+    };
+
+    // One chunk of a parallel lex, lexed into its own value stores so that the
+    // chunks do not contend; the merge interns the values again in source order.
+    template <bool AsciiOnly>
+    struct Lexer::Impl<AsciiOnly>::Segment {
+        Segment(SourceBuffer& source, std::size_t begin, std::size_t end, LiteralMode literal_mode)
+            : diagnostics(&lexer.m_dispatch_position)
+            , lexer(value_stores, source, diagnostics, literal_mode)
+            , begin(begin)
+            , end(end)
+        {
+            lexer.m_is_segment = true;
+        }
+
+        Segment(Segment const&) = delete;
+        Segment(Segment&&) = delete;
+        Segment& operator=(Segment const&) = delete;
+        Segment& operator=(Segment&&) = delete;
+        ~Segment() = default;
+
+        auto lex() -> void {
+            stop = lexer.lex_range(begin, end);
+        }
+
+        SharedValueStores value_stores;
+        SegmentDiagnosticConsumer diagnostics;
+        Impl lexer;
+        std::size_t begin;
+        std::size_t end;
+        std::size_t stop{};
+    };
+
+    // Lexes with every literal pending and the lexer's own diagnostics held
+    // back, then converts the literals in one batch. Eager lexing reports a
+    // literal's diagnostics while dispatching at its offset, so they go right
+    // after whatever was emitted before that.
+    template <bool AsciiOnly>
+    struct Lexer::Impl<AsciiOnly>::Deferred {
+        Deferred(SharedValueStores& value_stores, SourceBuffer& source)
+            : diagnostics(&lexer.m_dispatch_position)
+            , lexer(value_stores, source, diagnostics, LiteralMode::Batch)
+        {
+        }
+
+        Deferred(Deferred const&) = delete;
+        Deferred(Deferred&&) = delete;
+        Deferred& operator=(Deferred const&) = delete;
+        Deferred& operator=(Deferred&&) = delete;
+        ~Deferred() = default;
+
+        auto lex(DiagnosticConsumer& consumer, unsigned thread_count) && -> TokenizedBuffer {
+            [[maybe_unused]] auto _ = lexer.add_token(TokenKind::FileStart, 0, 0);
+            lexer.lex_range(0, lexer.m_buffer.m_source->get_source().size());
+            return std::move(*this).finish(consumer, thread_count);
+        }
+
+        auto finish(DiagnosticConsumer& consumer, unsigned thread_count) && -> TokenizedBuffer {
+            auto tokens = std::move(lexer).finish();
+            auto literals = tokens.compute_pending_literals(thread_count);
+            auto literal = literals.begin();
+            for (auto& entry: diagnostics.entries) {
+                for (; literal != literals.end() && literal->offset < entry.position; ++literal) {
+                    consumer.consume(std::move(literal->diagnostic));
+                }
+                consumer.consume(std::move(entry.diagnostic));
+            }
+            for (; literal != literals.end(); ++literal) {
+                consumer.consume(std::move(literal->diagnostic));
+            }
+            return tokens;
+        }
+
+        SegmentDiagnosticConsumer diagnostics;
+        Impl lexer;
+    };
+
+    template <bool AsciiOnly>
+    auto Lexer::Impl<AsciiOnly>::append_segment(Impl& segment, SegmentDiagnosticConsumer& diagnostics) -> void {
+        auto const source = m_buffer.m_source->get_source();
+        auto const& tokens = segment.m_buffer;
+        auto& values = *tokens.m_value_store;
+        auto diagnostic = diagnostics.entries.begin();
+
+        // Everything the serial lexer emits while dispatching at `position`
+        // comes before the token it adds there. The dispatch position follows
+        // along for a `Deferred` merge.
+        auto const flush_diagnostics = [&](std::size_t position) {
+            for (; diagnostic != diagnostics.entries.end() && diagnostic->position <= position; ++diagnostic) {
+                m_dispatch_position = diagnostic->position;
+                m_consumer.consume(std::move(diagnostic->diagnostic));
+            }
+        };
+
+        if (segment.m_has_leading_space) note_whitespace();
+
+        for (auto token: tokens.tokens()) {
+            auto const kind = tokens.get_kind(token);
+            auto const position = static_cast<std::size_t>(tokens.get_token_offset(token));
+            flush_diagnostics(position);
+            m_dispatch_position = position;
+
+            if (kind.is_opening_symbol()) {
+                add_opening_symbol(kind, position);
+            } else if (kind.is_closing_symbol()) {
+                add_closing_symbol(kind, source, position);
+            } else if (tokens.is_pending(token)) {
+                m_buffer.mark_pending(add_token(kind, position, tokens.m_lengths[token]));
+            } else {
+                auto const merged = add_token(kind, position, tokens.m_lengths[token]);
+                auto& payload = m_buffer.get_payload(merged);
+                switch (kind) {
+                    case TokenKind::Identifier:
+                        payload.id = m_buffer.m_value_store->identifier().add_borrowed(values.identifier().get(tokens.get_identifier(token)));
+                        break;
+                    case TokenKind::IntegerLiteral:
+                        payload.integer = m_buffer.m_value_store->ints().add(values.ints().get(tokens.get_int_literal(token)));
+                        break;
+                    case TokenKind::RealLiteral:
+                        payload.reals = m_buffer.m_value_store->reals().add(values.reals().get(tokens.get_real_literal(token)));
+                        break;
+                    case TokenKind::StringLiteral: {
+                        // Decoded values live in the segment's allocator, which goes away
+                        // after the merge.
+                        auto value = llvm::StringRef(values.string_literal().get(tokens.get_string_literal(token)));
+                        if (!utils::string_contains_ptr(source, value.data())) value = value.copy(m_buffer.m_allocator);
+                        payload.string_literal = m_buffer.m_value_store->string_literal().add_borrowed(value);
+                        break;
+                    }
+                    default:
+                        break;
+                }
+            }
+
+            if (tokens.has_trailing_whitespace(token)) note_whitespace();
+        }
+
+        flush_diagnostics(source.size());
+    }
+
+    template <bool AsciiOnly>
+    auto Lexer::Impl<AsciiOnly>::lex_chunks(
+        SourceBuffer& source,
+        SharedValueStores& value_stores,
+        DiagnosticConsumer& consumer,
+        llvm::ArrayRef<std::size_t> boundaries,
+        unsigned thread_count,
+        LiteralMode literal_mode
+    ) -> TokenizedBuffer {
+        auto segments = llvm::SmallVector<std::unique_ptr<Segment>>();
+        segments.reserve(boundaries.size() - 1);
+        for (auto i = std::size_t{ 1 }; i < boundaries.size(); ++i) {
+            segments.push_back(std::make_unique<Segment>(source, boundaries[i - 1], boundaries[i], literal_mode));
+        }
+
+        {
+            auto pool = llvm::ThreadPool(llvm::hardware_concurrency(thread_count));
+            for (auto& segment: segments) {
+                pool.async([segment = segment.get()] { segment->lex(); });
+            }
+            pool.wait();
+        }
+
+        // A chunk is only valid if the previous one stopped exactly at its start.
+        // Otherwise a multi-line string ran over the boundary, and the chunk is
+        // lexed again from where that string ended.
+        auto const merge = [&](Impl& result) {
+            [[maybe_unused]] auto _ = result.add_token(TokenKind::FileStart, 0, 0);
+            auto resume = std::size_t{};
+            for (auto& segment: segments) {
+                if (resume >= segment->end) continue;
+                if (resume != segment->begin) {
+                    segment = std::make_unique<Segment>(source, resume, segment->end, literal_mode);
+                    segment->lex();
+                }
+                resume = segment->stop;
+                result.append_segment(segment->lexer, segment->diagnostics);
+                segment.reset();
+            }
+        };
+
+        if (literal_mode == LiteralMode::Batch) {
+            auto merged = Deferred(value_stores, source);
+            merge(merged.lexer);
+            return std::move(merged).finish(consumer, thread_count);
+        }
+
+        auto result = Impl(value_stores, source, consumer, literal_mode);
+        merge(result);
+        return std::move(result).finish();
+    }
+
+    template <bool AsciiOnly>
+    constexpr auto Lexer::Impl<AsciiOnly>::make_dispatch_table() -> std::array<DispatchFunction*, 256> {
+        auto table = std::array<DispatchFunction*, 256>{};
+
+        for (auto& entry: table) {
+            entry = +[](Impl& lexer, llvm::StringRef source, std::size_t& position) {
+                lexer.lex_error(source, position);
+            };
+        }
+
+        #define DARK_SYMBOL_TOKEN(TokenName, Spelling, SnakeCaseName) \
+            table[static_cast<unsigned char>((Spelling)[0])] = +[](Impl& lexer, llvm::StringRef source, std::size_t& position) { \
+                lexer.lex_symbol(source, position); \
+            };
+        #define DARK_OPENING_GROUP_SYMBOL_TOKEN(TokenName, Spelling, ClosingName, SnakeCaseName) \
+            table[static_cast<unsigned char>((Spelling)[0])] = +[](Impl& lexer, llvm::StringRef source, std::size_t& position) { \
+                lexer.lex_opening_symbol(TokenKind::TokenName, source, position); \
+            };
+        #define DARK_CLOSING_GROUP_SYMBOL_TOKEN(TokenName, Spelling, OpeningName, SnakeCaseName) \
+            table[static_cast<unsigned char>((Spelling)[0])] = +[](Impl& lexer, llvm::StringRef source, std::size_t& position) { \
+                lexer.lex_closing_symbol(TokenKind::TokenName, source, position); \
+            };
+        #include "lexer/token_kind.def"
+
+        auto const lex_word = +[](Impl& lexer, llvm::StringRef source, std::size_t& position) {
+            lexer.lex_word(source, position);
+        };
+
+        // Non-ASCII bytes cannot appear in an ASCII-only source.
+        for (auto c = 0u; c < 256u; ++c) {
+            if (identifier_start_chars[c] || (!AsciiOnly && c >= 0x80u)) table[c] = lex_word;
+        }
+
+        for (auto c = static_cast<unsigned>('0'); c <= static_cast<unsigned>('9'); ++c) {
+            table[c] = +[](Impl& lexer, llvm::StringRef source, std::size_t& position) {
+                lexer.lex_numeric_literal(source, position);
+            };
+        }
+
+        auto const lex_string = +[](Impl& lexer, llvm::StringRef source, std::size_t& position) {
+            lexer.lex_string_literal_or_hash(source, position);
+        };
+        table[static_cast<unsigned char>('"')] = lex_string;
+        table[static_cast<unsigned char>('\'')] = lex_string;
+        table[static_cast<unsigned char>('#')] = lex_string;
+
+        table[static_cast<unsigned char>('/')] = +[](Impl& lexer, llvm::StringRef source, std::size_t& position) {
+            lexer.lex_comment_or_error(source, position);
+        };
+
+        auto const lex_horizontal_whitespace = +[](Impl& lexer, llvm::StringRef source, std::size_t& position) {
+            lexer.lex_horizontal_whitespace(source, position);
+        };
+        table[static_cast<unsigned char>(' ')] = lex_horizontal_whitespace;
+        table[static_cast<unsigned char>('\t')] = lex_horizontal_whitespace;
+        table[static_cast<unsigned char>('\r')] = lex_horizontal_whitespace;
+        table[static_cast<unsigned char>('\n')] = +[](Impl& lexer, llvm::StringRef source, std::size_t& position) {
+            lexer.lex_vertical_whitespace(source, position);
+        };
+
+        return table;
+    }
+
+    template <bool AsciiOnly>
+    constexpr std::array<typename Lexer::Impl<AsciiOnly>::DispatchFunction*, 256> Lexer::Impl<AsciiOnly>::s_dispatch_table = Lexer::Impl<AsciiOnly>::make_dispatch_table();
+
+    // Consumes the whole run of bytes that cannot start any token.
+    template <bool AsciiOnly>
+    auto Lexer::Impl<AsciiOnly>::lex_error(llvm::StringRef source, std::size_t& position) -> void {
+        auto const error_handler = s_dispatch_table[0];
+        auto end = position + 1;
+        while (end < source.size() && s_dispatch_table[static_cast<unsigned char>(source[end])] == error_handler) {
+            ++end;
+        }
+
+        emit_unrecognized(source, position);
+        add_error_token(position, end - position);
+        position = end;
+    }
+
+    auto Lexer::lex(
+        SourceBuffer& source,
+        SharedValueStores& value_stores,
+        DiagnosticConsumer& consumer,
+        LiteralMode literal_mode
+    ) -> TokenizedBuffer {
+        return lex_source(source, value_stores, consumer, literal_mode, /*thread_count=*/0);
+    }
+
+    auto Lexer::lex_source(
+        SourceBuffer& source,
+        SharedValueStores& value_stores,
+        DiagnosticConsumer& consumer,
+        LiteralMode literal_mode,
+        unsigned thread_count
+    ) -> TokenizedBuffer {
+        if (literal_mode == LiteralMode::Batch) {
+            if (source.is_ascii()) {
+                return Impl<true>::Deferred(value_stores, source).lex(consumer, thread_count);
+            }
+            return Impl<false>::Deferred(value_stores, source).lex(consumer, thread_count);
+        }
+
+        if (source.is_ascii()) {
+            return Impl<true>(value_stores, source, consumer, literal_mode).lex();
+        }
+        return Impl<false>(value_stores, source, consumer, literal_mode).lex();
+    }
+
+    auto Lexer::lex_parallel(
+        SourceBuffer& source,
+        SharedValueStores& value_stores,
+        DiagnosticConsumer& consumer,
+        unsigned thread_count,
+        std::size_t chunk_size,
+        LiteralMode literal_mode
+    ) -> TokenizedBuffer {
+        dark_assert(chunk_size > 0, "Chunk size must be positive");
+
+        if (literal_mode == LiteralMode::Eager && source.get_source().size() >= batch_literal_threshold) {
+            literal_mode = LiteralMode::Batch;
+        }
+
+        // Chunks start right after a newline, where the serial lexer is in its
+        // initial state unless it is inside a multi-line string.
+        auto const text = source.get_source();
+        auto boundaries = llvm::SmallVector<std::size_t>{ 0 };
+        while (text.size() - boundaries.back() > chunk_size) {
+            auto const newline = text.find('\n', boundaries.back() + chunk_size);
+            if (newline == llvm::StringRef::npos || newline + 1 == text.size()) break;
+            boundaries.push_back(newline + 1);
+        }
+        boundaries.push_back(text.size());
+
+        if (boundaries.size() <= 2) {
+            return lex_source(source, value_stores, consumer, literal_mode, thread_count);
+        }
+
+        if (source.is_ascii()) {
+            return Impl<true>::lex_chunks(source, value_stores, consumer, boundaries, thread_count, literal_mode);
+        }
+        return Impl<false>::lex_chunks(source, value_stores, consumer, boundaries, thread_count, literal_mode);
+    }
+
+    namespace {
+        // Keeps the diagnostics of one file of a batch until every earlier file
+        // has reported its own.
+        struct BufferedDiagnosticConsumer: DiagnosticConsumer {
+            auto consume(Diagnostic&& diagnostic) -> void override {
+                diagnostics.push_back(std::move(diagnostic));
+            }
+
+            llvm::SmallVector<Diagnostic, 0> diagnostics;
+        };
+    } // namespace
+
+    auto Lexer::lex_batch(
+        llvm::ArrayRef<SourceBuffer*> sources,
+        SharedValueStores& value_stores,
+        DiagnosticConsumer& consumer,
+        unsigned thread_count,
+        llvm::StringRef cache_directory
+    ) -> llvm::SmallVector<TokenizedBuffer, 0> {
+        // Files are lexed into their own stores, so workers never share mutable
+        // state and the merge below can run in file order.
+        struct File {
+            SharedValueStores value_stores;
+            BufferedDiagnosticConsumer diagnostics;
+            std::optional<TokenizedBuffer> tokens;
+        };
+
+        auto files = llvm::SmallVector<std::unique_ptr<File>>();
+        files.reserve(sources.size());
+        for (auto i = std::size_t{}; i < sources.size(); ++i) {
+            files.push_back(std::make_unique<File>());
+        }
+
+        {
+            auto pool = llvm::ThreadPool(llvm::hardware_concurrency(thread_count));
+            for (auto i = std::size_t{}; i < sources.size(); ++i) {
+                pool.async([file = files[i].get(), source = sources[i], cache_directory] {
+                    auto snapshot_path = llvm::SmallString<128>();
+                    auto source_hash = std::uint64_t{};
+                    if (!cache_directory.empty()) {
+                        source_hash = TokenSnapshot::hash_source(*source);
+                        snapshot_path = cache_directory;
+                        llvm::sys::path::append(snapshot_path, TokenSnapshot::get_filename(source_hash));
+                        if (auto snapshot = TokenSnapshot::open(snapshot_path, *source, source_hash)) {
+                            file->tokens.emplace(snapshot->load(*source, file->value_stores));
+                            return;
+                        }
+                    }
+
+                    file->tokens.emplace(lex(*source, file->value_stores, file->diagnostics));
+
+                    // Snapshots do not replay diagnostics, so only clean files are cached.
+                    if (!snapshot_path.empty() && file->diagnostics.diagnostics.empty()) {
+                        TokenSnapshot::write(*file->tokens, snapshot_path, source_hash);
+                    }
+                });
+            }
+            pool.wait();
+        }
+
+        auto result = llvm::SmallVector<TokenizedBuffer, 0>();
+        result.reserve(files.size());
+        for (auto& file: files) {
+            for (auto& diagnostic: file->diagnostics.diagnostics) {
+                consumer.consume(std::move(diagnostic));
+            }
+            rebind_values(*file->tokens, value_stores);
+            result.push_back(std::move(*file->tokens));
+        }
+        return result;
+    }
+
+    // Interning the file's values in their local id order assigns the same ids
+    // as lexing the file directly into `value_stores`.
+    auto Lexer::rebind_values(TokenizedBuffer& tokens, SharedValueStores& value_stores) -> void {
+        auto& local = *tokens.m_value_store;
+
+        auto strings = llvm::SmallVector<StringId, 0>();
+        strings.reserve(local.strings().size());
+        for (auto i = std::size_t{}; i < local.strings().size(); ++i) {
+            strings.push_back(value_stores.strings().add_borrowed(local.strings().get(StringId(i))));
+        }
+
+        auto ints = llvm::SmallVector<IntId, 0>();
+        ints.reserve(local.ints().size());
+        for (auto const& value: local.ints().array_ref()) {
+            ints.push_back(value_stores.ints().add(value));
+        }
+
+        auto reals = llvm::SmallVector<RealId, 0>();
+        reals.reserve(local.reals().array_ref().size());
+        for (auto const& value: local.reals().array_ref()) {
+            reals.push_back(value_stores.reals().add(value));
+        }
+
+        auto doubles = llvm::SmallVector<RealId, 0>();
+        doubles.reserve(local.reals().double_array_ref().size());
+        for (auto value: local.reals().double_array_ref()) {
+            doubles.push_back(value_stores.reals().add(value));
+        }
+
+        for (auto token: tokens.tokens()) {
+            auto& payload = tokens.get_payload(token);
+            switch (tokens.get_kind(token)) {
+                case TokenKind::Identifier:
+                    payload.id = IdentifierId(strings[payload.id.as_unsigned()].index);
+                    break;
+                case TokenKind::StringLiteral:
+                    payload.string_literal = StringLiteralId(strings[payload.string_literal.as_unsigned()].index);
+                    break;
+                case TokenKind::IntegerLiteral:
+                    if (!payload.integer.is_embedded()) payload.integer = ints[payload.integer.as_unsigned()];
+                    break;
+                case TokenKind::RealLiteral:
+                    payload.reals = payload.reals.is_double()
+                        ? doubles[payload.reals.get_double_index()]
+                        : reals[payload.reals.as_unsigned()];
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        tokens.m_value_store = &value_stores;
+    }
+
+} // namespace dark::lexer
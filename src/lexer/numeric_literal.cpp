@@ -4,15 +4,25 @@
 #include "common/bit_array.hpp"
 #include "common/cow.hpp"
 #include "common/format.hpp"
+#include "common/real_conversion.hpp"
 #include "common/span.hpp"
 #include "diagnostics/basic_diagnostic.hpp"
 #include "diagnostics/diagnostic_emitter.hpp"
 #include "lexer/character_set.hpp"
 #include <algorithm>
+#include <bit>
+#include <cstdint>
 #include <iterator>
+#include <limits>
+#include <llvm/ADT/SmallString.h>
 #include <llvm/ADT/APInt.h>
 #include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Endian.h>
 #include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <variant>
 
 namespace dark::lexer {
 
@@ -28,7 +38,7 @@ namespace dark::lexer {
         auto const n = input.size();
         for (; i < n; ++i) {
             auto const c = input[i];
-            if (char_set::is_alnum(c) || '_') {
+            if (char_set::is_alnum(c) || c == '_') {
                 if (char_set::is_lower(c) && seen_radix_point && !seen_potential_exponent) {
                     // 123.e2
                     //     ^
@@ -63,22 +73,137 @@ namespace dark::lexer {
         return res;
     }
 
-    inline static auto parse_int(
-        llvm::StringRef source,
-        NumericLiteral::Radix radix,
-        bool needs_cleaning
-    ) -> SignedBigNum {
-
-        llvm::SmallString<32> cleaned_source;
-        if (needs_cleaning) {
-            cleaned_source.reserve(source.size());
-            std::remove_copy_if(source.begin(), source.end(), std::back_inserter(cleaned_source), [](char c) {
-                return c == '_' || c == '.';
-            });
-            source = cleaned_source;
+    static auto get_valid_digits(NumericLiteral::Radix radix) noexcept -> BitArray<256> const& {
+        switch (radix) {
+            case NumericLiteral::Radix::Binary: return char_set::detail::binary_digits;
+            case NumericLiteral::Radix::Octal: return char_set::detail::octal_digits;
+            case NumericLiteral::Radix::Decimal: return char_set::detail::decimal_digits;
+            case NumericLiteral::Radix::Hexadecimal: return char_set::detail::hexadecimal_digits;
         }
+        std::unreachable();
+    }
+
+    // What one pass over a digit sequence learns about it.
+    struct DigitScan {
+        // Index of the first byte that is neither a digit nor a separator, or
+        // the size of the sequence if there is none.
+        std::size_t invalid{};
+        // Bit `i` is set if byte `i` is a separator. Only the first 64 bytes
+        // are recorded.
+        std::uint64_t separators{};
+        unsigned separator_count{};
+        // The value of the digits, or nothing once it does not fit in 64 bits.
+        std::optional<std::uint64_t> value{};
+    };
+
+    namespace swar {
+        constexpr auto broadcast(std::uint8_t byte) noexcept -> std::uint64_t {
+            return 0x0101'0101'0101'0101ull * byte;
+        }
+
+        constexpr auto high_bits = broadcast(0x80);
+
+        // Sets the high bit of every byte of `word` in [first, last]. The bytes
+        // must be below 0x80, so no sum carries into the next byte.
+        constexpr auto in_range(std::uint64_t word, std::uint8_t first, std::uint8_t last) noexcept -> std::uint64_t {
+            auto const at_least_first = word + broadcast(static_cast<std::uint8_t>(0x80 - first));
+            auto const past_last = word + broadcast(static_cast<std::uint8_t>(0x7F - last));
+            return at_least_first & ~past_last & high_bits;
+        }
+
+        // Gathers the high bit of each byte into the low 8 bits.
+        constexpr auto to_mask(std::uint64_t high) noexcept -> std::uint64_t {
+            return (high * 0x0002'0408'1020'4081ull) >> 56;
+        }
+
+        // Folds eight digit values, first digit in the lowest byte, into one
+        // number by multiplying adjacent lanes together. Every intermediate lane
+        // fits in its width for radices up to 16.
+        constexpr auto reduce(std::uint64_t digits, std::uint64_t radix) noexcept -> std::uint64_t {
+            digits = (digits * radix + (digits >> 8)) & 0x00FF'00FF'00FF'00FFull;
+            digits = (digits * (radix * radix) + (digits >> 16)) & 0x0000'FFFF'0000'FFFFull;
+            auto const radix_4 = radix * radix * radix * radix;
+            return (digits * radix_4 + (digits >> 32)) & 0xFFFF'FFFFull;
+        }
+    } // namespace swar
+
+    // Validates `source` as digits of `radix` with separators, locates the
+    // separators and accumulates the value, all in one pass of eight bytes at
+    // a time.
+    inline static auto scan_digits(llvm::StringRef source, NumericLiteral::Radix radix) noexcept -> DigitScan {
+        auto const base = static_cast<std::uint64_t>(radix);
+        auto const data = source.data();
+        auto const size = source.size();
+        auto result = DigitScan{ .invalid = size };
+
+        auto value = std::uint64_t{};
+        auto overflow = false;
+        auto const accumulate = [&](std::uint64_t scale, std::uint64_t digits) {
+            overflow = overflow
+                || __builtin_mul_overflow(value, scale, &value)
+                || __builtin_add_overflow(value, digits, &value);
+        };
+        auto const digit_value = [](char c) {
+            return static_cast<std::uint64_t>(char_set::is_digit(c) ? c - '0' : (c | 0x20) - 'a' + 10);
+        };
+
+        auto const last_digit = static_cast<std::uint8_t>('0' + std::min<std::uint64_t>(base, 10) - 1);
+        auto const scale = base * base * base * base * base * base * base * base;
+
+        auto i = std::size_t{};
+        for (; i + 8 <= size; i += 8) {
+            auto const word = llvm::support::endian::read64le(data + i);
+            auto const ascii = word & swar::broadcast(0x7F);
+            auto digits = swar::in_range(ascii, '0', last_digit);
+            if (base == 16) digits |= swar::in_range(ascii | swar::broadcast(0x20), 'a', 'f');
+            digits &= ~word;
+            auto const separators = swar::in_range(ascii, '_', '_') & ~word;
+
+            auto const invalid = ~(digits | separators) & swar::high_bits;
+            if (invalid != 0) {
+                result.invalid = i + static_cast<std::size_t>(std::countr_zero(invalid)) / 8;
+                return result;
+            }
+
+            if (separators == 0) {
+                auto const values = (word & swar::broadcast(0x0F)) + ((word >> 6) & swar::broadcast(0x01)) * 9;
+                accumulate(scale, swar::reduce(values, base));
+            } else {
+                for (auto j = i; j < i + 8; ++j) {
+                    if (data[j] != '_') accumulate(base, digit_value(data[j]));
+                }
+                if (i < 64) result.separators |= swar::to_mask(separators) << i;
+                result.separator_count += static_cast<unsigned>(std::popcount(separators));
+            }
+        }
+
+        auto const& valid_digits = get_valid_digits(radix);
+        for (; i < size; ++i) {
+            auto const c = data[i];
+            if (c == '_') {
+                if (i < 64) result.separators |= std::uint64_t{ 1 } << i;
+                ++result.separator_count;
+            } else if (valid_digits[static_cast<unsigned char>(c)]) {
+                accumulate(base, digit_value(c));
+            } else {
+                result.invalid = i;
+                return result;
+            }
+        }
+
+        if (!overflow) result.value = value;
+        return result;
+    }
 
-        return SignedBigNum(source, static_cast<unsigned>(radix));
+    // GMP reads up to a NUL, so the digits are always copied out of the source
+    // even when there is nothing to strip.
+    inline static auto parse_big_int(llvm::StringRef source, NumericLiteral::Radix radix) -> SignedBigNum {
+        llvm::SmallString<64> digits;
+        digits.reserve(source.size() + 1);
+        std::remove_copy_if(source.begin(), source.end(), std::back_inserter(digits), [](char c) {
+            return c == '_' || c == '.';
+        });
+        return SignedBigNum(std::string_view(digits.c_str(), digits.size()), static_cast<unsigned>(radix));
     }
 
     struct NumericLiteral::Parser {
@@ -89,21 +214,14 @@ namespace dark::lexer {
             , m_frac_part(m_literal.get_source().substr(m_literal.m_radix_point + 1, m_literal.m_exponent - m_literal.m_radix_point - 1))
             , m_exp_part(m_literal.get_source().substr(m_literal.m_exponent + 1))
         {
-            if (m_int_part.consume_front("0x")) {
-                m_radix = Radix::Hexadecimal;
-            } else if (m_int_part.consume_front("0b")) {
-                m_radix = Radix::Binary;
-            } else if (m_int_part.consume_front("0o")) {
-                m_radix = Radix::Octal;
-            } else {
-                m_radix = Radix::Decimal;
-            }
+            m_radix = NumericLiteral::get_radix(m_int_part);
+            if (m_radix != Radix::Decimal) m_int_part = m_int_part.drop_front(2);
 
             if (!m_exp_part.consume_front("+")) {
                 m_exponent_is_negative = m_exp_part.consume_front("-");
             }
         }
-        constexpr auto is_integer() const noexcept -> bool { return m_literal.m_radix_point == m_literal.get_source().size(); }
+        constexpr auto is_integer() const noexcept -> bool { return m_literal.is_integer(); }
         constexpr auto is_real() const noexcept -> bool { return !is_integer(); }
 
         auto check() noexcept -> bool {
@@ -113,50 +231,100 @@ namespace dark::lexer {
         // Returns the radix of the numeric literal 2, 8, 10, or 16
         constexpr auto get_radix() const noexcept -> Radix { return m_radix; }
 
-        auto get_mantissa() const -> SignedBigNum {
+        // Only valid after a successful `check`, which leaves the value of each
+        // part behind when it fits in 64 bits.
+        auto get_mantissa() const -> Integer {
+            if (auto mantissa = get_fixed_mantissa()) {
+                return { Integer::Fixed{ .magnitude = *mantissa } };
+            }
+
             auto end = is_integer() ? m_int_part.end() : m_frac_part.end();
             auto digits = llvm::StringRef(m_int_part.begin(), static_cast<size_t>(end - m_int_part.begin()));
-            return parse_int(digits, m_radix, m_mantissa_needs_cleaning);
+            return { parse_big_int(digits, m_radix) };
         }
-        auto get_exponent() -> SignedBigNum {
-            SignedBigNum exponent;
-            if (!m_exp_part.empty()) {
-                exponent = parse_int(m_exp_part, Radix::Decimal, m_exponent_needs_cleaning);
-            }
-
-            if (m_exponent_is_negative) {
-                exponent = -exponent;
-            }
 
+        auto get_exponent() const -> Integer {
             std::size_t excess_exponent = m_frac_part.size();
             if (m_radix == Radix::Hexadecimal) {
                 excess_exponent *= 4;
             }
 
-            exponent -= excess_exponent;
+            auto const written = m_exp_part.empty() ? std::optional<std::uint64_t>(0) : m_exp_value;
+            if (written) {
+                // The exponent is `±written - excess`; it stays in a word unless
+                // the written part alone is beyond `int64_t`.
+                auto const limit = static_cast<std::uint64_t>(std::numeric_limits<std::int64_t>::max());
+                if (*written <= limit && excess_exponent <= limit) {
+                    auto exponent = static_cast<std::int64_t>(*written);
+                    if (m_exponent_is_negative) exponent = -exponent;
+                    if (!__builtin_sub_overflow(exponent, static_cast<std::int64_t>(excess_exponent), &exponent)) {
+                        auto const is_negative = exponent < 0;
+                        auto const magnitude = is_negative
+                            ? std::uint64_t{ 0 } - static_cast<std::uint64_t>(exponent)
+                            : static_cast<std::uint64_t>(exponent);
+                        return { Integer::Fixed{ .magnitude = magnitude, .is_negative = is_negative } };
+                    }
+                }
+            }
+
+            auto exponent = written
+                ? SignedBigNum(std::to_string(*written), 10)
+                : parse_big_int(m_exp_part, Radix::Decimal);
 
-            if (m_exponent_is_negative && !exponent.is_negative()) {
+            if (m_exponent_is_negative) {
                 exponent = -exponent;
             }
 
-            return exponent;
+            exponent -= excess_exponent;
+
+            return { std::move(exponent) };
         }
 
     private:
         struct CheckDigitSequenceResult {
             bool ok{false};
             bool has_digit_separators{false};
+            // The value of the digits if they fit in 64 bits.
+            std::optional<std::uint64_t> value{};
         };
 
-        constexpr auto check_digit_sequence(
+        // Well-formed sequences are settled by the scan alone; anything it
+        // flags is walked again byte by byte to report exactly what is wrong.
+        auto check_digit_sequence(
             llvm::StringRef source,
             Radix radix,
             bool allow_digit_separators = true
         ) const noexcept -> CheckDigitSequenceResult {
-            auto const& valid_digits = (radix == Radix::Binary) ? char_set::detail::binary_digits
-                : (radix == Radix::Octal) ? char_set::detail::octal_digits
-                : (radix == Radix::Decimal) ? char_set::detail::decimal_digits
-                : char_set::detail::hexadecimal_digits;
+            auto const scan = scan_digits(source, radix);
+            auto const n = source.size();
+            if (scan.invalid == n && scan.separator_count < n) {
+                if (scan.separator_count == 0) {
+                    return { .ok = true, .value = scan.value };
+                }
+
+                // Only the first 64 bytes have separator bits; longer sequences
+                // are left to the byte walk.
+                if (allow_digit_separators && n <= 64) {
+                    auto const separators = scan.separators;
+                    auto const misplaced = (separators & 1) | ((separators >> (n - 1)) & 1) | (separators & (separators << 1));
+                    if (misplaced == 0) {
+                        check_digit_separator_position(source, radix, separators);
+                        return { .ok = true, .has_digit_separators = true, .value = scan.value };
+                    }
+                }
+            }
+
+            auto result = diagnose_digit_sequence(source, radix, allow_digit_separators);
+            if (result.ok) result.value = scan.value;
+            return result;
+        }
+
+        auto diagnose_digit_sequence(
+            llvm::StringRef source,
+            Radix radix,
+            bool allow_digit_separators
+        ) const noexcept -> CheckDigitSequenceResult {
+            auto const& valid_digits = get_valid_digits(radix);
 
             unsigned num_digit_separators = 0;
             auto n = source.size();
@@ -205,6 +373,30 @@ namespace dark::lexer {
             };
         }
 
+        static constexpr auto get_separator_stride(Radix radix) noexcept -> unsigned {
+            switch (radix) {
+                case Radix::Decimal: return 4;
+                case Radix::Octal: return 3;
+                case Radix::Hexadecimal: return 5;
+                default: std::unreachable();
+            }
+        }
+
+        auto build_irregular_separators(llvm::StringRef source, Radix radix) const {
+            DARK_DIAGNOSTIC(IrregularDigitSeparators, Error,
+                "Digit separators in {} number should appear every {} characters "
+                "from the right.",
+                Radix, int
+            );
+
+            return m_emitter.build(
+                source.begin(),
+                IrregularDigitSeparators,
+                radix,
+                static_cast<int>(get_separator_stride(radix)) - 1
+            );
+        }
+
         auto check_digit_separator_position(llvm::StringRef source, Radix radix, unsigned num_digit_separators) const noexcept -> void {
             dark_assert(std::count(source.begin(), source.end(), '_') == num_digit_separators, "num_digit_separators is incorrect");
 
@@ -212,36 +404,14 @@ namespace dark::lexer {
                 return;
             }
 
-            auto stride = 4;
-            switch (radix) {
-                case Radix::Decimal: stride = 4; break;
-                case Radix::Octal: stride = 3; break;
-                case Radix::Hexadecimal: stride = 5; break;
-                default: std::unreachable();
-            }
-
-            auto irregular_diagnostics = [this, source, radix, stride]() {
-                DARK_DIAGNOSTIC(IrregularDigitSeparators, Error,
-                    "Digit separators in {} number should appear every {} characters "
-                    "from the right.",
-                    Radix, int
-                );
-
-                return m_emitter.build(
-                    source.begin(),
-                    IrregularDigitSeparators,
-                    radix,
-                    stride - 1
-                );
-            };
-
+            auto const stride = static_cast<std::ptrdiff_t>(get_separator_stride(radix));
             auto remaining_separator = num_digit_separators;
             auto pos = source.end();
             while (std::distance(source.begin(), pos) >= stride) {
                 pos -= stride;
                 if (*pos != '_') {
                     auto distance = static_cast<unsigned>(std::distance(source.begin(), pos));
-                    irregular_diagnostics()
+                    build_irregular_separators(source, radix)
                         .add_error_suggestion("Misplaced digit separator.", Span(distance, distance + 1).to_relative())
                         .emit();
                     return;
@@ -251,7 +421,37 @@ namespace dark::lexer {
             }
 
             if (remaining_separator != 0) {
-                irregular_diagnostics()
+                build_irregular_separators(source, radix)
+                    .add_child_info_context("Remove the misplaced digit separator.")
+                    .emit();
+            }
+        }
+
+        // Same checks against the separator bits of a scan, for sequences of at
+        // most 64 bytes.
+        auto check_digit_separator_position(llvm::StringRef source, Radix radix, std::uint64_t separators) const noexcept -> void {
+            if (radix == Radix::Binary) {
+                return;
+            }
+
+            auto const stride = get_separator_stride(radix);
+            auto expected = std::uint64_t{};
+            for (auto pos = static_cast<unsigned>(source.size()); pos >= stride;) {
+                pos -= stride;
+                expected |= std::uint64_t{ 1 } << pos;
+            }
+
+            if (auto const missing = expected & ~separators; missing != 0) {
+                // The scalar walk reports the rightmost gap, so this does too.
+                auto const distance = static_cast<unsigned>(63 - std::countl_zero(missing));
+                build_irregular_separators(source, radix)
+                    .add_error_suggestion("Misplaced digit separator.", Span(distance, distance + 1).to_relative())
+                    .emit();
+                return;
+            }
+
+            if ((separators & ~expected) != 0) {
+                build_irregular_separators(source, radix)
                     .add_child_info_context("Remove the misplaced digit separator.")
                     .emit();
             }
@@ -268,9 +468,25 @@ namespace dark::lexer {
             return true;
         }
 
+        // The fractional digits continue the integer ones, so the mantissa is
+        // `int * radix^fraction_digits + fraction`.
+        auto get_fixed_mantissa() const noexcept -> std::optional<std::uint64_t> {
+            if (!m_int_value) return std::nullopt;
+            auto mantissa = *m_int_value;
+            if (is_integer()) return mantissa;
+            if (!m_frac_value) return std::nullopt;
+
+            auto const radix = static_cast<std::uint64_t>(m_radix);
+            for (auto i = std::size_t{}; i < m_frac_part.size(); ++i) {
+                if (__builtin_mul_overflow(mantissa, radix, &mantissa)) return std::nullopt;
+            }
+            if (__builtin_add_overflow(mantissa, *m_frac_value, &mantissa)) return std::nullopt;
+            return mantissa;
+        }
+
         auto check_integer_part() noexcept -> bool {
             auto result = check_digit_sequence(m_int_part, m_radix);
-            m_mantissa_needs_cleaning = m_mantissa_needs_cleaning || result.has_digit_separators;
+            m_int_value = result.value;
             return result.ok;
         }
         auto check_fractional_part() noexcept -> bool {
@@ -294,8 +510,9 @@ namespace dark::lexer {
                 return false;
             }
 
-            m_mantissa_needs_cleaning = false;
-            return check_digit_sequence(m_frac_part, m_radix, /*allow_digit_separators=*/false).ok;
+            auto result = check_digit_sequence(m_frac_part, m_radix, /*allow_digit_separators=*/false);
+            m_frac_value = result.value;
+            return result.ok;
         }
 
         auto check_exponent_part() noexcept -> bool {
@@ -312,9 +529,9 @@ namespace dark::lexer {
                 .emit();
             }
 
-            auto exponent_result = check_digit_sequence(m_exp_part, Radix::Decimal);
-            m_exponent_needs_cleaning = m_exponent_needs_cleaning || exponent_result.has_digit_separators;
-            return exponent_result.ok;
+            auto result = check_digit_sequence(m_exp_part, Radix::Decimal);
+            m_exp_value = result.value;
+            return result.ok;
         }
 
     private:
@@ -324,11 +541,29 @@ namespace dark::lexer {
         llvm::StringRef m_int_part;
         llvm::StringRef m_frac_part;
         llvm::StringRef m_exp_part;
-        bool m_mantissa_needs_cleaning{false};
-        bool m_exponent_needs_cleaning{false};
+        std::optional<std::uint64_t> m_int_value;
+        std::optional<std::uint64_t> m_frac_value;
+        std::optional<std::uint64_t> m_exp_value;
         bool m_exponent_is_negative{false};
     };
 
+    auto NumericLiteral::RealValue::get_exact_double() const -> std::optional<double> {
+        auto const* mantissa_value = std::get_if<Integer::Fixed>(&mantissa.value);
+        auto const* exponent_value = std::get_if<Integer::Fixed>(&exponent.value);
+        if (!mantissa_value || !exponent_value) return std::nullopt;
+
+        // Fixed exponents are built from an `int64_t`, so the magnitude of a
+        // positive one is at most its maximum.
+        auto const magnitude = exponent_value->magnitude;
+        auto const power = exponent_value->is_negative
+            ? static_cast<std::int64_t>(std::uint64_t{ 0 } - magnitude)
+            : static_cast<std::int64_t>(magnitude);
+
+        return radix == Radix::Decimal
+            ? exact_decimal_to_double(mantissa_value->magnitude, power)
+            : exact_binary_to_double(mantissa_value->magnitude, power);
+    }
+
     auto NumericLiteral::compute_value(DiagnosticEmitter<char const*> emitter) const -> value_type {
         auto parser = Parser(emitter, *this);
         if (!parser.check()) return UnrecoverableError{};
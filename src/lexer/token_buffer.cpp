@@ -1,81 +1,55 @@
 #include "lexer/token_buffer.hpp"
 #include "common/assert.hpp"
-#include "common/format.hpp"
 #include "common/string_utils.hpp"
-#include "lexer/numeric_literal.hpp"
-#include "lexer/token_kind.hpp"
 #include "lexer/string_literal.hpp"
+#include "lexer/token_kind.hpp"
 #include <algorithm>
+#include <array>
 #include <cstddef>
+#include <iterator>
+#include <llvm/ADT/SmallVector.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/Support/FormatVariadic.h>
 #include <llvm/Support/Format.h>
+#include <llvm/Support/ThreadPool.h>
+#include <llvm/Support/Threading.h>
+#include <memory>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <variant>
 
 namespace dark::lexer {
 
-    [[nodiscard]] auto TokenizedBuffer::get_end_loc(TokenIndex token) const noexcept -> std::pair<LineIndex, unsigned> {
-        auto line = get_line(token);
-        auto column = get_column_number(token);
-        auto text = get_token_text(token);
-
-        if (auto [first_half, second_half] = text.rsplit('\n'); second_half.empty()) {
-            column += first_half.size();
-        } else {
-            line.index += static_cast<unsigned>(first_half.count('\n')) + 1;
-            column = static_cast<unsigned>(1 + second_half.size());
-        }
-
-        return {line, column};
+    [[nodiscard]] auto TokenizedBuffer::get_line(TokenIndex token) const noexcept -> LineIndex {
+        auto const [line, _] = m_source->get_line_table().lookup(get_token_offset(token));
+        return LineIndex(static_cast<IdBase::inner_type>(line));
     }
 
-    [[nodiscard]] auto TokenizedBuffer::get_token_text(TokenIndex token) const noexcept -> llvm::StringRef {
-        auto const& info = get_token_info(token);
-        auto spelling = info.kind.fixed_spelling();
-
-        if (!spelling.empty()) return spelling;
-
-        if (info.kind.is_error()) {
-            auto const& line = get_line_info(info.line);
-            auto token_start = line.start + static_cast<unsigned>(info.column);
-            return m_source->get_source().substr(token_start, static_cast<unsigned>(info.error_length));
-        }
-
-        if (info.kind.is_real_literal() || info.kind.is_integer_literal()) {
-            auto const& line_info = get_line_info(info.line);
-            auto token_start = line_info.start + static_cast<unsigned>(info.column);
-            auto relaxed_token = NumericLiteral::lex(m_source->get_source().substr(token_start));
-            dark_assert(relaxed_token.has_value(), (std::format(
-                "{}:{}:{}: Could not reconstruct the numeric literal.",
-                m_source->get_filename(),
-                line_info.start,
-                info.column
-            )));
-            return relaxed_token->get_source();
-        }
-
-        if (info.kind.is_string_literal()) {
-            auto const& line_info = get_line_info(info.line);
-            auto token_start = line_info.start + static_cast<unsigned>(info.column);
-            auto relaxed_token = StringLiteral::lex(m_source->get_source().substr(token_start));
-            dark_assert(relaxed_token.has_value(), (std::format(
-                "{}:{}:{}: Could not reconstruct the string literal.",
-                m_source->get_filename(),
-                line_info.start,
-                info.column
-            )));
-            return relaxed_token->get_source();
-        }
+    [[nodiscard]] auto TokenizedBuffer::get_column_number(TokenIndex token) const noexcept -> offset_type {
+        auto const [_, column] = m_source->get_line_table().lookup(get_token_offset(token));
+        return column + 1;
+    }
 
-        if (info.kind.is_file_start() || info.kind.is_file_end()) {
-            return {};
-        }
+    [[nodiscard]] auto TokenizedBuffer::get_indent_column_number(LineIndex index) const noexcept -> offset_type {
+        auto const text = m_source->get_line_table().get_line(m_source->get_source(), index.as_unsigned());
+        auto const indent = text.find_first_not_of(" \t\r");
+        return indent == llvm::StringRef::npos ? 1 : static_cast<offset_type>(indent + 1);
+    }
 
-        dark_assert(info.kind.is_identifier(), Formatter("{}", info.kind).format());
+    [[nodiscard]] auto TokenizedBuffer::get_end_loc(TokenIndex token) const noexcept -> std::pair<LineIndex, offset_type> {
+        auto const end = get_token_offset(token) + m_lengths[token];
+        auto const [line, column] = m_source->get_line_table().lookup(end);
+        return { LineIndex(static_cast<IdBase::inner_type>(line)), column + 1 };
+    }
 
-        return m_value_store->identifier().get(info.id);
+    [[nodiscard]] auto TokenizedBuffer::get_token_text(TokenIndex token) const noexcept -> llvm::StringRef {
+        auto const kind = get_kind(token);
+        if (auto spelling = kind.fixed_spelling(); !spelling.empty()) return spelling;
+        return m_source->get_source().substr(get_token_offset(token), m_lengths[token]);
     }
 
-    [[nodiscard]] inline constexpr auto compute_number_of_digits(unsigned number) noexcept -> unsigned {
+    [[nodiscard]] inline constexpr auto compute_number_of_digits(TokenizedBuffer::offset_type number) noexcept -> unsigned {
         unsigned digits = 1;
         while (number) {
             number /= 10;
@@ -86,10 +60,10 @@ namespace dark::lexer {
 
     [[nodiscard]] auto TokenizedBuffer::get_print_widths(TokenIndex token) const noexcept -> PrintWidths {
         return {
-            .index = compute_number_of_digits(static_cast<unsigned>(m_token_infos.size())),
+            .index = compute_number_of_digits(static_cast<offset_type>(size())),
             .kind = static_cast<unsigned>(get_kind(token).name().size()),
-            .line = compute_number_of_digits(static_cast<unsigned>(get_line(token).index)),
-            .column = compute_number_of_digits(static_cast<unsigned>(get_column_number(token))),
+            .line = compute_number_of_digits(get_line(token).as_unsigned()),
+            .column = compute_number_of_digits(get_column_number(token)),
             .indent = compute_number_of_digits(get_indent_column_number(get_line(token)))
         };
     }
@@ -97,51 +71,58 @@ namespace dark::lexer {
     auto TokenizedBuffer::print_token(llvm::raw_ostream& os, TokenIndex token, PrintWidths widths) const -> void {
         widths.widen(get_print_widths(token));
         auto token_index = token.index;
-        auto const& info = get_token_info(token);
+        auto const kind = get_kind(token);
+        auto const line = get_line(token);
         auto token_text = get_token_text(token);
 
         os << llvm::formatv(
                 "    { index: {0}, kind: {1}, line: {2}, column: {3}, indent: {4}, "
                 "spelling: '{5}'",
                 llvm::format_decimal(token_index, widths.index),
-                llvm::right_justify(llvm::formatv("'{0}'", info.kind.name()).str(), widths.kind + 2),
-                llvm::format_decimal(get_line_number(info.line), widths.line),
+                llvm::right_justify(llvm::formatv("'{0}'", kind.name()).str(), widths.kind + 2),
+                llvm::format_decimal(get_line_number(line), widths.line),
                 llvm::format_decimal(get_column_number(token), widths.column),
-                llvm::format_decimal(get_indent_column_number(info.line), widths.indent),
+                llvm::format_decimal(get_indent_column_number(line), widths.indent),
                 token_text
             );
 
-        switch (info.kind) {
+        switch (kind) {
             case TokenKind::Identifier:
                 os << ", Identifier: '" << get_identifier(token).index << "'";
                 break;
+            // A lazily read literal whose value could not be computed has no id
+            // until `materialize_all` turns it into an error.
             case TokenKind::IntegerLiteral:
-                os << ", Value: `";
-                m_value_store->ints().get(get_int_literal(token)).print(os, /*isSigned*/false);
-                os << "`";
+                if (auto const id = get_int_literal(token); id.is_valid()) {
+                    os << ", Value: `";
+                    m_value_store->ints().get(id).print(os, /*isSigned*/false);
+                    os << "`";
+                }
                 break;
             case TokenKind::RealLiteral:
-                os << ", Value: `"; 
-                m_value_store->reals().get(get_real_literal(token)).print(os);
-                os << "`";
+                if (auto const id = get_real_literal(token); id.is_valid()) {
+                    os << ", Value: `"; 
+                    m_value_store->reals().get(id).print(os);
+                    os << "`";
+                }
                 break;
             case TokenKind::StringLiteral:
                 os << ", Value: `" << m_value_store->string_literal().get(get_string_literal(token)) << "`";
                 break;
             default:
-                if (info.kind.is_opening_symbol()) {
+                if (kind.is_opening_symbol()) {
                     os << ", closing token: " << get_matched_closing_token(token).index;
-                } else if (info.kind.is_closing_symbol()) {
+                } else if (kind.is_closing_symbol()) {
                     os << ", opening token: " << get_matched_opening_token(token).index;
                 }
                 break;
         }
         
-        if (info.has_trailing_space) {
+        if (has_trailing_whitespace(token)) {
             os << ", trailing_space: true";
         }
 
-        if (info.is_recovery) {
+        if (is_recovery_token(token)) {
             os << ", recovery: true";
         }
 
@@ -157,7 +138,7 @@ namespace dark::lexer {
            << "  tokens: [\n";
 
         auto widths = PrintWidths{
-            .index = compute_number_of_digits(static_cast<unsigned>(m_token_infos.size()))
+            .index = compute_number_of_digits(static_cast<offset_type>(size()))
         };
 
         for (auto token: tokens()) {
@@ -175,47 +156,261 @@ namespace dark::lexer {
         print_token(os, token, {});
     }
 
-    auto TokenizedBuffer::SourceBufferDiagnosticConverter::convert_loc(char const* loc, [[maybe_unused]] context_fn_t context_fn) const -> DiagnosticLocation {
-        dark_assert(utils::string_contains_ptr(m_buffer->m_source->get_source(), loc), "loc is not in the buffer");
-        std::ptrdiff_t offset = loc - m_buffer->m_source->get_source().begin();
+    namespace {
+        // Records which pending literal each diagnostic of a chunk belongs to,
+        // so they can be reported in token order once every chunk is done.
+        struct ChunkDiagnosticConsumer: DiagnosticConsumer {
+            struct Entry {
+                std::size_t position;
+                Diagnostic diagnostic;
+            };
+
+            auto consume(Diagnostic&& diagnostic) -> void override {
+                entries.push_back({ .position = position, .diagnostic = std::move(diagnostic) });
+            }
+
+            std::size_t position{};
+            llvm::SmallVector<Entry, 0> entries;
+        };
 
-        auto line_it = std::partition_point(
-            m_buffer->m_line_infos.begin(),
-            m_buffer->m_line_infos.end(),
-            [offset](LineInfo const& line) { return line.start <= offset; }
+        constexpr auto materialize_chunk_size = std::size_t{ 4096 };
+
+        // Strings, then integers and reals by radix. A chunk only holds literals
+        // of one group, so it runs a single conversion path.
+        constexpr auto literal_group_count = std::size_t{ 9 };
+
+        [[nodiscard]] auto get_literal_group(TokenKind kind, llvm::StringRef spelling) noexcept -> std::size_t {
+            if (kind == TokenKind::StringLiteral) return 0;
+            auto const radix = [&] {
+                switch (NumericLiteral::get_radix(spelling)) {
+                    case NumericLiteral::Radix::Decimal: return std::size_t{ 0 };
+                    case NumericLiteral::Radix::Hexadecimal: return std::size_t{ 1 };
+                    case NumericLiteral::Radix::Binary: return std::size_t{ 2 };
+                    case NumericLiteral::Radix::Octal: return std::size_t{ 3 };
+                }
+                return std::size_t{ 0 };
+            }();
+            return 1 + (kind == TokenKind::RealLiteral ? 4 : 0) + radix;
+        }
+    } // namespace
+
+    auto TokenizedBuffer::compute_literal_value(
+        TokenIndex token,
+        llvm::BumpPtrAllocator& allocator,
+        DiagnosticEmitter<char const*>& emitter
+    ) const -> LiteralValue {
+        auto const source = m_source->get_source().substr(get_token_offset(token));
+        if (get_kind(token) == TokenKind::StringLiteral) {
+            auto literal = StringLiteral::lex(source);
+            dark_assert(literal.has_value(), "A string literal token no longer lexes");
+            return literal->compute_value(allocator, emitter);
+        }
+
+        auto literal = NumericLiteral::lex(source);
+        dark_assert(literal.has_value(), "A numeric literal token no longer lexes");
+        return literal->compute_value(emitter);
+    }
+
+    auto TokenizedBuffer::set_literal_value(TokenIndex token, LiteralValue const& value) const -> bool {
+        clear_pending(token);
+
+        auto& payload = m_payloads[token];
+        if (auto const* text = std::get_if<llvm::StringRef>(&value)) {
+            payload.string_literal = m_value_store->string_literal().add_borrowed(*text);
+            return true;
+        }
+
+        return std::visit([&](auto const& number) {
+            using type = std::decay_t<decltype(number)>;
+            if constexpr (std::is_same_v<type, NumericLiteral::IntValue>) {
+                payload.integer = m_value_store->ints().add(number.value.to_apint());
+                return true;
+            } else if constexpr (std::is_same_v<type, NumericLiteral::RealValue>) {
+                // Reals that are exactly a double are kept as one.
+                auto& reals = m_value_store->reals();
+                if (auto exact = number.get_exact_double()) {
+                    payload.reals = reals.add(*exact);
+                } else {
+                    auto real = Real();
+                    real.mantissa = number.mantissa.to_apint();
+                    real.exponent = number.exponent.to_apint();
+                    real.is_decimal = number.radix == NumericLiteral::Radix::Decimal;
+                    payload.reals = reals.add(std::move(real));
+                }
+                return true;
+            } else {
+                payload = TokenPayload();
+                return false;
+            }
+        }, std::get<NumericLiteral::value_type>(value));
+    }
+
+    auto TokenizedBuffer::set_literal_error(TokenIndex token) -> void {
+        auto& kind = m_kinds[token];
+        m_expected_parse_tree_size += TokenKind::Error.expected_parse_tree_size() - kind.expected_parse_tree_size();
+        kind = TokenKind::Error;
+    }
+
+    namespace {
+        // Keeps the diagnostics of one literal for `materialize_all` to report.
+        struct HeldDiagnosticConsumer: DiagnosticConsumer {
+            auto consume(Diagnostic&& diagnostic) -> void override {
+                diagnostics.push_back(std::move(diagnostic));
+            }
+
+            llvm::SmallVector<Diagnostic, 1> diagnostics;
+        };
+    } // namespace
+
+    auto TokenizedBuffer::materialize_pending(TokenIndex token) const -> void {
+        auto lock = std::lock_guard(m_lazy->mutex);
+        if (!is_pending(token)) return;
+
+        auto consumer = HeldDiagnosticConsumer();
+        auto converter = SourceBufferDiagnosticConverter(this);
+        auto emitter = DiagnosticEmitter<char const*>(converter, consumer);
+        if (!set_literal_value(token, compute_literal_value(token, m_allocator, emitter))) {
+            m_lazy->failed.push_back(token);
+        }
+        for (auto& diagnostic: consumer.diagnostics) {
+            m_lazy->diagnostics.push_back({ .offset = get_token_offset(token), .diagnostic = std::move(diagnostic) });
+        }
+    }
+
+    auto TokenizedBuffer::materialize_all(DiagnosticConsumer& consumer, unsigned thread_count) -> void {
+        if (m_lazy == nullptr) return;
+        auto lazy = std::move(m_lazy);
+
+        // A literal is either read before or converted here, so merging the two
+        // lists by offset keeps each literal's diagnostics together and in the
+        // order they were emitted.
+        auto diagnostics = compute_pending_literals(thread_count);
+        for (auto& entry: lazy->diagnostics) {
+            m_has_errors |= entry.diagnostic.level == DiagnosticLevel::Error;
+        }
+        for (auto token: lazy->failed) set_literal_error(token);
+
+        auto merged = llvm::SmallVector<LiteralDiagnostic, 0>();
+        merged.reserve(diagnostics.size() + lazy->diagnostics.size());
+        std::stable_sort(lazy->diagnostics.begin(), lazy->diagnostics.end(), [](auto const& lhs, auto const& rhs) {
+            return lhs.offset < rhs.offset;
+        });
+        std::merge(
+            std::make_move_iterator(lazy->diagnostics.begin()), std::make_move_iterator(lazy->diagnostics.end()),
+            std::make_move_iterator(diagnostics.begin()), std::make_move_iterator(diagnostics.end()),
+            std::back_inserter(merged),
+            [](auto const& lhs, auto const& rhs) { return lhs.offset < rhs.offset; }
         );
+        for (auto& entry: merged) {
+            consumer.consume(std::move(entry.diagnostic));
+        }
+    }
+
+    auto TokenizedBuffer::compute_pending_literals(unsigned thread_count) -> llvm::SmallVector<LiteralDiagnostic, 0> {
+        if (m_pending_count == 0) return {};
+
+        auto pending = llvm::SmallVector<TokenIndex, 0>();
+        pending.reserve(m_pending_count);
+        auto groups = std::array<llvm::SmallVector<std::size_t, 0>, literal_group_count>();
+        for (auto index: m_pending.set_bits()) {
+            auto const token = TokenIndex(static_cast<IdBase::inner_type>(index));
+            auto const kind = get_kind(token);
+            if (kind != TokenKind::Identifier) {
+                groups[get_literal_group(kind, get_token_text(token))].push_back(pending.size());
+            }
+            pending.push_back(token);
+        }
 
-        dark_assert(line_it != m_buffer->m_line_infos.begin(), "loc is before the first line");
-        --line_it;
-        auto const line_number = static_cast<unsigned>(line_it - m_buffer->m_line_infos.begin());
-        auto const column_number = static_cast<unsigned>(offset - line_it->start);
+        // Each chunk converts into its own allocator and diagnostics, and into
+        // its own slots of `values`.
+        struct Chunk {
+            llvm::ArrayRef<std::size_t> positions;
+            llvm::BumpPtrAllocator allocator;
+            ChunkDiagnosticConsumer diagnostics;
+        };
 
-        auto line = m_buffer->m_source->get_source().substr(line_it->start, line_it->length);
+        auto chunks = llvm::SmallVector<std::unique_ptr<Chunk>>();
+        for (auto const& group: groups) {
+            for (auto rest = llvm::ArrayRef<std::size_t>(group); !rest.empty(); rest = rest.drop_front(std::min(rest.size(), materialize_chunk_size))) {
+                chunks.push_back(std::make_unique<Chunk>());
+                chunks.back()->positions = rest.take_front(materialize_chunk_size);
+            }
+        }
 
-        if (line_it->length == LineInfo::npos) {
-            dark_assert(
-                line.take_front(column_number).count('\n') == 0,
-                Formatter("Assumption: there is no unlexed newline before the error column\n{}:{}:{}", m_buffer->m_source->get_filename(), line_number, column_number).format()
-            );
+        auto values = llvm::SmallVector<std::optional<LiteralValue>, 0>(pending.size());
+        auto const convert = [this, &pending, &values](Chunk& chunk) {
+            auto converter = SourceBufferDiagnosticConverter(this);
+            auto emitter = DiagnosticEmitter<char const*>(converter, chunk.diagnostics);
+            for (auto position: chunk.positions) {
+                chunk.diagnostics.position = position;
+                values[position].emplace(compute_literal_value(pending[position], chunk.allocator, emitter));
+            }
+        };
 
-            auto end_pos = line.find('\n', column_number);
-            if (end_pos != llvm::StringRef::npos) {
-                line = line.take_front(end_pos);
+        if (thread_count == 1 || chunks.size() == 1) {
+            for (auto& chunk: chunks) convert(*chunk);
+        } else {
+            auto pool = llvm::ThreadPool(llvm::hardware_concurrency(thread_count));
+            for (auto& chunk: chunks) {
+                pool.async([&convert, chunk = chunk.get()] { convert(*chunk); });
             }
+            pool.wait();
         }
 
+        // Chunks report their literals in order, so a stable sort by position
+        // keeps the diagnostics of one literal in the order they were emitted.
+        auto entries = llvm::SmallVector<ChunkDiagnosticConsumer::Entry, 0>();
+        for (auto& chunk: chunks) {
+            std::move(chunk->diagnostics.entries.begin(), chunk->diagnostics.entries.end(), std::back_inserter(entries));
+        }
+        std::stable_sort(entries.begin(), entries.end(), [](auto const& lhs, auto const& rhs) {
+            return lhs.position < rhs.position;
+        });
+
+        // Decoded strings live in the chunks' allocators, which go away with
+        // the chunks.
+        auto const source = m_source->get_source();
+        for (auto position = std::size_t{}; position < pending.size(); ++position) {
+            auto const token = pending[position];
+            if (!values[position]) {
+                m_payloads[token].id = m_value_store->identifier().add_borrowed(get_token_text(token));
+                clear_pending(token);
+                continue;
+            }
+
+            auto& value = *values[position];
+            if (auto* text = std::get_if<llvm::StringRef>(&value); text && !utils::string_contains_ptr(source, text->data())) {
+                *text = text->copy(m_allocator);
+            }
+            if (!set_literal_value(token, value)) set_literal_error(token);
+        }
+
+        auto result = llvm::SmallVector<LiteralDiagnostic, 0>();
+        result.reserve(entries.size());
+        for (auto& entry: entries) {
+            m_has_errors |= entry.diagnostic.level == DiagnosticLevel::Error;
+            result.push_back({ .offset = get_token_offset(pending[entry.position]), .diagnostic = std::move(entry.diagnostic) });
+        }
+        return result;
+    }
+
+    auto TokenizedBuffer::SourceBufferDiagnosticConverter::convert_loc(char const* loc, [[maybe_unused]] context_fn_t context_fn) const -> DiagnosticLocation {
+        auto const source = m_buffer->m_source->get_source();
+        dark_assert(utils::string_contains_ptr(source, loc), "loc is not in the buffer");
+
+        auto const& line_table = m_buffer->m_source->get_line_table();
+        auto const [line, column] = line_table.lookup(static_cast<offset_type>(loc - source.begin()));
+
         return {
             .filename = m_buffer->m_source->get_filename(),
-            .line = line,
-            .line_number = line_number + 1,
-            .column_number = column_number + 1,
+            .line = line_table.get_line(source, line),
+            .line_number = static_cast<unsigned>(line + 1),
+            .column_number = static_cast<unsigned>(column + 1),
         };
     }
 
     auto TokenDiagnosticConverter::convert_loc(TokenIndex loc, context_fn_t context_fn) const -> DiagnosticLocation {
-        auto const& token_info = m_buffer->get_token_info(loc);
-        auto const& line_info = m_buffer->get_line_info(token_info.line);
-        auto token_start = m_buffer->m_source->get_source().data() + line_info.start + token_info.column;
+        auto token_start = m_buffer->m_source->get_source().data() + m_buffer->get_token_offset(loc);
 
         auto new_loc = TokenizedBuffer::SourceBufferDiagnosticConverter{m_buffer}.convert_loc(token_start, context_fn);
         new_loc.length = static_cast<unsigned>(m_buffer->get_token_text(loc).size());
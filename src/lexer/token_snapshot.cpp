@@ -0,0 +1,470 @@
+#include "lexer/token_snapshot.hpp"
+#include "common/assert.hpp"
+#include "common/string_utils.hpp"
+#include <bit>
+#include <cstring>
+#include <limits>
+#include <llvm/ADT/DenseMap.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/Support/Error.h>
+#include <llvm/Support/Format.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Support/xxhash.h>
+#include <type_traits>
+
+namespace dark::lexer {
+
+    namespace {
+        constexpr auto snapshot_magic = std::array<char, 8>{ 'D', 'A', 'R', 'K', 'T', 'O', 'K', 'S' };
+        constexpr auto section_alignment = std::size_t{ 8 };
+
+        constexpr auto token_kind_count = std::size_t{ 0 }
+        #define DARK_TOKEN(TokenName, SnakeCaseName) + 1
+        #include "lexer/token_kind.def"
+        ;
+
+        static_assert(std::is_trivially_copyable_v<TokenKind> && sizeof(TokenKind) == 1, "Token kinds are mapped in place as bytes");
+
+        [[nodiscard]] constexpr auto word_count(std::size_t bits) noexcept -> std::size_t {
+            return (bits + 63) / 64;
+        }
+
+        [[nodiscard]] auto raw_kind(TokenKind kind) noexcept -> std::uint8_t {
+            return static_cast<std::uint8_t>(static_cast<detail::TokenKindRawEnum>(kind));
+        }
+    } // namespace
+
+    struct TokenSnapshot::Writer {
+        Writer(TokenizedBuffer const& tokens, std::uint64_t source_hash)
+            : m_tokens(tokens)
+            , m_source(tokens.source().get_source())
+            , m_source_hash(source_hash)
+        {
+        }
+
+        auto run() -> std::string {
+            auto const count = m_tokens.size();
+            auto payloads = llvm::SmallVector<IdBase::inner_type, 0>();
+            payloads.reserve(count);
+            for (auto token: m_tokens.tokens()) {
+                payloads.push_back(renumber(token));
+            }
+
+            auto kinds = llvm::SmallVector<std::uint8_t, 0>();
+            kinds.reserve(count);
+            auto trailing_space = llvm::SmallVector<std::uint64_t, 0>(word_count(count), 0);
+            auto recovery = llvm::SmallVector<std::uint64_t, 0>(word_count(count), 0);
+            for (auto token: m_tokens.tokens()) {
+                auto const index = static_cast<std::size_t>(token);
+                kinds.push_back(raw_kind(m_tokens.get_kind(token)));
+                trailing_space[index / 64] |= std::uint64_t{ m_tokens.has_trailing_whitespace(token) } << (index % 64);
+                recovery[index / 64] |= std::uint64_t{ m_tokens.is_recovery_token(token) } << (index % 64);
+            }
+
+            auto header = Header{};
+            header.magic = snapshot_magic;
+            header.version = TokenSnapshot::version;
+            header.id_size = sizeof(IdBase::inner_type);
+            header.source_hash = m_source_hash;
+            header.source_size = m_source.size();
+            header.expected_parse_tree_size = m_tokens.expected_parse_tree_size();
+            header.has_errors = m_tokens.has_error();
+
+            auto image = std::string(sizeof(Header), '\0');
+            append(image, header, Section::Kinds, llvm::ArrayRef<std::uint8_t>(kinds));
+            append(image, header, Section::TrailingSpace, llvm::ArrayRef<std::uint64_t>(trailing_space));
+            append(image, header, Section::Recovery, llvm::ArrayRef<std::uint64_t>(recovery));
+            append(image, header, Section::Offsets, llvm::ArrayRef<TokenizedBuffer::offset_type>(m_tokens.m_offsets));
+            append(image, header, Section::Lengths, llvm::ArrayRef<TokenizedBuffer::offset_type>(m_tokens.m_lengths));
+            append(image, header, Section::Payloads, llvm::ArrayRef<IdBase::inner_type>(payloads));
+            append(image, header, Section::LineStarts, m_tokens.source().get_line_table().get_line_starts());
+            append(image, header, Section::Strings, llvm::ArrayRef<StringEntry>(m_strings));
+            append(image, header, Section::StringBytes, llvm::ArrayRef<char>(m_string_bytes.data(), m_string_bytes.size()));
+            append(image, header, Section::Ints, llvm::ArrayRef<IntEntry>(m_ints));
+            append(image, header, Section::Reals, llvm::ArrayRef<RealEntry>(m_reals));
+            append(image, header, Section::IntWords, llvm::ArrayRef<std::uint64_t>(m_int_words));
+            append(image, header, Section::Doubles, llvm::ArrayRef<double>(m_doubles));
+            std::memcpy(image.data(), &header, sizeof(Header));
+            return image;
+        }
+
+    private:
+        template <typename T>
+        static auto append(std::string& image, Header& header, Section section, llvm::ArrayRef<T> values) -> void {
+            static_assert(std::is_trivially_copyable_v<T>, "Sections are copied byte by byte");
+            image.resize((image.size() + section_alignment - 1) & ~(section_alignment - 1), '\0');
+            header.sections[static_cast<std::size_t>(section)] = {
+                .offset = image.size(),
+                .size = values.size() * sizeof(T)
+            };
+            image.append(reinterpret_cast<char const*>(values.data()), values.size() * sizeof(T));
+        }
+
+        auto renumber(TokenIndex token) -> IdBase::inner_type {
+            auto const payload = std::bit_cast<IdBase::inner_type>(m_tokens.m_payloads[token]);
+            auto const& values = *m_tokens.m_value_store;
+            switch (m_tokens.get_kind(token)) {
+                case TokenKind::Identifier: {
+                    // Identifiers are always spelled in the source, even when the store
+                    // kept another file's copy.
+                    return add_string(payload, [&] {
+                        return StringEntry{ .offset = m_tokens.get_token_offset(token), .length = static_cast<std::uint32_t>(m_tokens.m_lengths[token]), .is_owned = 0 };
+                    });
+                }
+                case TokenKind::StringLiteral: {
+                    return add_string(payload, [&] {
+                        auto const value = values.string_literal().get(m_tokens.get_string_literal(token));
+                        if (utils::string_contains_ptr(m_source, value.data()) && value.data() + value.size() <= m_source.end()) {
+                            return StringEntry{ .offset = static_cast<std::uint64_t>(value.data() - m_source.data()), .length = static_cast<std::uint32_t>(value.size()), .is_owned = 0 };
+                        }
+                        auto const offset = m_string_bytes.size();
+                        m_string_bytes.append(value);
+                        return StringEntry{ .offset = offset, .length = static_cast<std::uint32_t>(value.size()), .is_owned = 1 };
+                    });
+                }
+                case TokenKind::IntegerLiteral: {
+                    auto const id = m_tokens.get_int_literal(token);
+                    if (id.is_embedded()) return payload;
+                    return add_value(m_int_map, payload, m_ints, [&] {
+                        return add_words(values.ints().get(id).to_apint());
+                    });
+                }
+                case TokenKind::RealLiteral: {
+                    auto const id = m_tokens.get_real_literal(token);
+                    if (id.is_double()) {
+                        auto const index = add_value(m_double_map, payload, m_doubles, [&] {
+                            return values.reals().get(id).get_double();
+                        });
+                        return RealId::make_double(static_cast<std::size_t>(index)).index;
+                    }
+                    return add_value(m_real_map, payload, m_reals, [&] {
+                        auto const& real = values.reals().get(id).get_real();
+                        return RealEntry{ .mantissa = add_words(real.mantissa), .exponent = add_words(real.exponent), .is_decimal = std::uint64_t{ real.is_decimal } };
+                    });
+                }
+                default:
+                    return payload;
+            }
+        }
+
+        template <typename MakeFn>
+        auto add_string(IdBase::inner_type id, MakeFn&& make) -> IdBase::inner_type {
+            return add_value(m_string_map, id, m_strings, std::forward<MakeFn>(make));
+        }
+
+        // Values get local ids in the order their first token refers to them.
+        template <typename EntryT, typename MakeFn>
+        static auto add_value(
+            llvm::DenseMap<IdBase::inner_type, IdBase::inner_type>& map,
+            IdBase::inner_type id,
+            llvm::SmallVectorImpl<EntryT>& entries,
+            MakeFn&& make
+        ) -> IdBase::inner_type {
+            auto [it, inserted] = map.try_emplace(id, static_cast<IdBase::inner_type>(entries.size()));
+            if (inserted) entries.push_back(make());
+            return it->second;
+        }
+
+        auto add_words(llvm::APInt const& value) -> IntEntry {
+            auto const entry = IntEntry{
+                .bit_width = value.getBitWidth(),
+                .word_count = value.getNumWords(),
+                .word_offset = m_int_words.size()
+            };
+            m_int_words.append(value.getRawData(), value.getRawData() + value.getNumWords());
+            return entry;
+        }
+
+        TokenizedBuffer const& m_tokens;
+        llvm::StringRef m_source;
+        std::uint64_t m_source_hash;
+        llvm::DenseMap<IdBase::inner_type, IdBase::inner_type> m_string_map;
+        llvm::DenseMap<IdBase::inner_type, IdBase::inner_type> m_int_map;
+        llvm::DenseMap<IdBase::inner_type, IdBase::inner_type> m_real_map;
+        llvm::DenseMap<IdBase::inner_type, IdBase::inner_type> m_double_map;
+        llvm::SmallVector<StringEntry, 0> m_strings;
+        std::string m_string_bytes;
+        llvm::SmallVector<IntEntry, 0> m_ints;
+        llvm::SmallVector<RealEntry, 0> m_reals;
+        llvm::SmallVector<std::uint64_t, 0> m_int_words;
+        llvm::SmallVector<double, 0> m_doubles;
+    };
+
+    auto TokenSnapshot::hash_source(SourceBuffer const& source) noexcept -> std::uint64_t {
+        return llvm::xxHash64(source.get_source());
+    }
+
+    auto TokenSnapshot::get_filename(SourceBuffer const& source) -> std::string {
+        return get_filename(hash_source(source));
+    }
+
+    auto TokenSnapshot::get_filename(std::uint64_t source_hash) -> std::string {
+        auto result = std::string();
+        auto os = llvm::raw_string_ostream(result);
+        os << llvm::format_hex_no_prefix(source_hash, 16) << extension;
+        return os.str();
+    }
+
+    auto TokenSnapshot::serialize(TokenizedBuffer const& tokens) -> std::optional<std::string> {
+        return serialize(tokens, hash_source(tokens.source()));
+    }
+
+    auto TokenSnapshot::serialize(TokenizedBuffer const& tokens, std::uint64_t source_hash) -> std::optional<std::string> {
+        // Pending literals could still become errors.
+        dark_assert(!tokens.has_pending_literals(), "Lazy literals are materialized before a snapshot is taken");
+        if constexpr (std::endian::native != std::endian::little) return std::nullopt;
+        return Writer(tokens, source_hash).run();
+    }
+
+    auto TokenSnapshot::write(TokenizedBuffer const& tokens, llvm::StringRef filename) -> bool {
+        return write(tokens, filename, hash_source(tokens.source()));
+    }
+
+    auto TokenSnapshot::write(TokenizedBuffer const& tokens, llvm::StringRef filename, std::uint64_t source_hash) -> bool {
+        auto image = serialize(tokens, source_hash);
+        if (!image) return false;
+        // Goes through a temporary file, so readers never map a half-written snapshot.
+        return !llvm::errorToBool(llvm::writeToOutput(filename, [&](llvm::raw_ostream& os) {
+            os << *image;
+            return llvm::Error::success();
+        }));
+    }
+
+    auto TokenSnapshot::open(llvm::StringRef filename, SourceBuffer const& source) -> std::optional<TokenSnapshot> {
+        return open(filename, source, hash_source(source));
+    }
+
+    auto TokenSnapshot::open(llvm::StringRef filename, SourceBuffer const& source, std::uint64_t source_hash) -> std::optional<TokenSnapshot> {
+        auto buffer = llvm::MemoryBuffer::getFile(filename, /*IsText=*/false, /*RequiresNullTerminator=*/false);
+        if (!buffer) return std::nullopt;
+        return open(std::move(*buffer), source, source_hash);
+    }
+
+    auto TokenSnapshot::open(std::unique_ptr<llvm::MemoryBuffer> buffer, SourceBuffer const& source) -> std::optional<TokenSnapshot> {
+        return open(std::move(buffer), source, hash_source(source));
+    }
+
+    auto TokenSnapshot::open(std::unique_ptr<llvm::MemoryBuffer> buffer, SourceBuffer const& source, std::uint64_t source_hash) -> std::optional<TokenSnapshot> {
+        if constexpr (std::endian::native != std::endian::little) return std::nullopt;
+
+        auto const data = buffer->getBuffer();
+        if (data.size() < sizeof(Header) || reinterpret_cast<std::uintptr_t>(data.data()) % section_alignment != 0) {
+            return std::nullopt;
+        }
+
+        auto header = Header{};
+        std::memcpy(&header, data.data(), sizeof(Header));
+        if (header.magic != snapshot_magic
+            || header.version != version
+            || header.id_size != sizeof(IdBase::inner_type)
+            || header.source_size != source.get_source().size()
+            || header.source_hash != source_hash) {
+            return std::nullopt;
+        }
+
+        auto snapshot = TokenSnapshot(std::move(buffer), header, source);
+        if (!snapshot.validate()) return std::nullopt;
+        return snapshot;
+    }
+
+    // Checks everything `load` and the accessors rely on, so a corrupt or
+    // hand-edited file is rejected instead of read out of bounds.
+    auto TokenSnapshot::validate() const -> bool {
+        auto const image_size = m_buffer->getBufferSize();
+        auto const element_sizes = std::array<std::size_t, section_count>{
+            sizeof(TokenKind),
+            sizeof(std::uint64_t),
+            sizeof(std::uint64_t),
+            sizeof(TokenizedBuffer::offset_type),
+            sizeof(TokenizedBuffer::offset_type),
+            sizeof(IdBase::inner_type),
+            sizeof(LineTable::offset_type),
+            sizeof(StringEntry),
+            sizeof(char),
+            sizeof(IntEntry),
+            sizeof(RealEntry),
+            sizeof(std::uint64_t),
+            sizeof(double)
+        };
+        for (auto i = std::size_t{}; i < section_count; ++i) {
+            auto const& range = m_header.sections[i];
+            if (range.offset % section_alignment != 0 || range.offset > image_size || range.size > image_size - range.offset) return false;
+            if (range.size % element_sizes[i] != 0) return false;
+        }
+
+        auto const count = size();
+        auto const source_size = m_source->get_source().size();
+        if (get_offsets().size() != count || get_lengths().size() != count || get_payloads().size() != count) return false;
+        if (get_section<std::uint64_t>(Section::TrailingSpace).size() != word_count(count)) return false;
+        if (get_section<std::uint64_t>(Section::Recovery).size() != word_count(count)) return false;
+
+        auto const line_starts = get_line_starts();
+        if (line_starts.empty() || line_starts.front() != 0) return false;
+        for (auto i = std::size_t{ 1 }; i < line_starts.size(); ++i) {
+            if (line_starts[i] <= line_starts[i - 1] || line_starts[i] > source_size) return false;
+        }
+
+        auto const string_bytes = get_section<char>(Section::StringBytes).size();
+        for (auto const& entry: get_section<StringEntry>(Section::Strings)) {
+            auto const limit = entry.is_owned ? string_bytes : source_size;
+            if (entry.is_owned > 1 || entry.offset > limit || entry.length > limit - entry.offset) return false;
+        }
+
+        auto const words = get_section<std::uint64_t>(Section::IntWords).size();
+        auto const is_valid_int = [words](IntEntry const& entry) {
+            return entry.bit_width != 0
+                && entry.word_count == word_count(entry.bit_width)
+                && entry.word_offset <= words
+                && entry.word_count <= words - entry.word_offset;
+        };
+        for (auto const& entry: get_section<IntEntry>(Section::Ints)) {
+            if (!is_valid_int(entry)) return false;
+        }
+        for (auto const& entry: get_section<RealEntry>(Section::Reals)) {
+            if (!is_valid_int(entry.mantissa) || !is_valid_int(entry.exponent) || entry.is_decimal > 1) return false;
+        }
+
+        auto const kinds = get_section<std::uint8_t>(Section::Kinds);
+        auto const payloads = get_payloads();
+        auto const in_range = [](IdBase::inner_type id, std::size_t limit) {
+            return id >= 0 && static_cast<std::size_t>(id) < limit;
+        };
+        for (auto i = std::size_t{}; i < count; ++i) {
+            if (kinds[i] >= token_kind_count) return false;
+            if (get_offsets()[i] > source_size || get_lengths()[i] > source_size - get_offsets()[i]) return false;
+
+            auto const kind = get_kinds()[i];
+            auto const payload = payloads[i];
+            auto is_valid = true;
+            if (kind == TokenKind::Identifier || kind == TokenKind::StringLiteral) {
+                is_valid = in_range(payload, string_count());
+            } else if (kind == TokenKind::IntegerLiteral) {
+                auto const id = IntId(payload);
+                is_valid = id.is_embedded()
+                    ? id.get_embedded_value() < (std::uint64_t{ 1 } << IntId::embedded_bits)
+                    : in_range(payload, int_count());
+            } else if (kind == TokenKind::RealLiteral) {
+                auto const id = RealId(payload);
+                is_valid = id.is_double()
+                    ? id.get_double_index() < double_count()
+                    : in_range(payload, real_count());
+            } else if (kind.is_opening_symbol() || kind.is_closing_symbol()) {
+                is_valid = in_range(payload, count);
+            }
+            if (!is_valid) return false;
+        }
+        return true;
+    }
+
+    auto TokenSnapshot::get_string(std::size_t index) const noexcept -> std::string_view {
+        auto const& entry = get_section<StringEntry>(Section::Strings)[index];
+        auto const* base = entry.is_owned ? get_section<char>(Section::StringBytes).data() : m_source->get_source().data();
+        return { base + entry.offset, entry.length };
+    }
+
+    auto TokenSnapshot::load_bits(Section section, llvm::BitVector& bits) const -> void {
+        // `setBitsInMask` takes 32-bit words and stops at the vector's size; on
+        // the little-endian hosts snapshots exist on, each 64-bit word is two of
+        // them in order.
+        auto const words = get_section<std::uint64_t>(section);
+        dark_assert(words.size() * 2 <= std::numeric_limits<unsigned>::max(), "Too many tokens for the per-token bit vectors");
+        bits.setBitsInMask(reinterpret_cast<std::uint32_t const*>(words.data()), static_cast<unsigned>(words.size() * 2));
+    }
+
+    auto TokenSnapshot::make_apint(IntEntry const& entry) const -> llvm::APInt {
+        auto const words = get_section<std::uint64_t>(Section::IntWords).slice(entry.word_offset, entry.word_count);
+        return llvm::APInt(entry.bit_width, words);
+    }
+
+    auto TokenSnapshot::get_int(std::size_t index) const -> llvm::APInt {
+        return make_apint(get_section<IntEntry>(Section::Ints)[index]);
+    }
+
+    auto TokenSnapshot::get_real(std::size_t index) const -> Real {
+        auto const& entry = get_section<RealEntry>(Section::Reals)[index];
+        auto real = Real();
+        real.mantissa = make_apint(entry.mantissa);
+        real.exponent = make_apint(entry.exponent);
+        real.is_decimal = entry.is_decimal != 0;
+        return real;
+    }
+
+    auto TokenSnapshot::load(SourceBuffer& source, SharedValueStores& value_stores) const -> TokenizedBuffer {
+        dark_assert(&source == m_source, "A snapshot loads into the source it was opened against");
+
+        auto tokens = TokenizedBuffer(value_stores, source);
+        source.set_line_table(LineTable::from_line_starts(get_line_starts()));
+
+        // Interning the tables in order repeats the sequence of first uses that
+        // lexing would have made.
+        auto strings = llvm::SmallVector<IdBase::inner_type, 0>();
+        strings.reserve(string_count());
+        for (auto i = std::size_t{}; i < string_count(); ++i) {
+            auto value = llvm::StringRef(get_string(i));
+            if (get_section<StringEntry>(Section::Strings)[i].is_owned) value = value.copy(tokens.m_allocator);
+            strings.push_back(value_stores.strings().add_borrowed(value).index);
+        }
+
+        auto ints = llvm::SmallVector<IntId, 0>();
+        ints.reserve(int_count());
+        for (auto i = std::size_t{}; i < int_count(); ++i) {
+            ints.push_back(value_stores.ints().add(get_int(i)));
+        }
+
+        auto reals = llvm::SmallVector<RealId, 0>();
+        reals.reserve(real_count());
+        for (auto i = std::size_t{}; i < real_count(); ++i) {
+            reals.push_back(value_stores.reals().add(get_real(i)));
+        }
+
+        auto doubles = llvm::SmallVector<RealId, 0>();
+        doubles.reserve(double_count());
+        for (auto value: get_doubles()) {
+            doubles.push_back(value_stores.reals().add(value));
+        }
+
+        auto const count = size();
+
+        auto const kinds = get_kinds();
+        auto const payloads = get_payloads();
+        tokens.m_kinds.assign(kinds.begin(), kinds.end());
+        tokens.m_offsets.assign(get_offsets().begin(), get_offsets().end());
+        tokens.m_lengths.assign(get_lengths().begin(), get_lengths().end());
+        dark_assert(count <= std::numeric_limits<unsigned>::max(), "Too many tokens for the per-token bit vectors");
+        tokens.m_trailing_space.resize(static_cast<unsigned>(count));
+        tokens.m_recovery.resize(static_cast<unsigned>(count));
+        load_bits(Section::TrailingSpace, tokens.m_trailing_space);
+        load_bits(Section::Recovery, tokens.m_recovery);
+
+        // Only the payloads need a pass of their own, to map the snapshot's
+        // value ids to the stores' ids.
+        tokens.m_payloads.resize(count);
+        for (auto i = std::size_t{}; i < count; ++i) {
+            auto& payload = tokens.m_payloads[i];
+            payload = std::bit_cast<TokenizedBuffer::TokenPayload>(payloads[i]);
+            switch (kinds[i]) {
+                case TokenKind::Identifier:
+                    payload.id = IdentifierId(strings[static_cast<std::size_t>(payloads[i])]);
+                    break;
+                case TokenKind::StringLiteral:
+                    payload.string_literal = StringLiteralId(strings[static_cast<std::size_t>(payloads[i])]);
+                    break;
+                case TokenKind::IntegerLiteral:
+                    if (!payload.integer.is_embedded()) payload.integer = ints[static_cast<std::size_t>(payloads[i])];
+                    break;
+                case TokenKind::RealLiteral:
+                    payload.reals = payload.reals.is_double()
+                        ? doubles[payload.reals.get_double_index()]
+                        : reals[static_cast<std::size_t>(payloads[i])];
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        tokens.m_expected_parse_tree_size = static_cast<int>(m_header.expected_parse_tree_size);
+        tokens.m_has_errors = m_header.has_errors != 0;
+        return tokens;
+    }
+
+} // namespace dark::lexer
@@ -0,0 +1,72 @@
+#include "source/line_table.hpp"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+
+#if defined(__AVX2__)
+    #include <immintrin.h>
+#elif defined(__SSE2__)
+    #include <emmintrin.h>
+#endif
+
+namespace dark {
+
+    namespace {
+        template <typename MaskT>
+        inline auto push_line_starts(llvm::SmallVectorImpl<LineTable::offset_type>& starts, std::size_t base, MaskT mask) -> void {
+            while (mask != 0) {
+                starts.push_back(static_cast<LineTable::offset_type>(base + static_cast<std::size_t>(std::countr_zero(mask)) + 1));
+                mask &= mask - 1;
+            }
+        }
+    } // namespace
+
+    LineTable::LineTable(llvm::StringRef source) {
+        auto const data = source.data();
+        auto const size = source.size();
+        auto i = std::size_t{};
+
+    #if defined(__AVX2__)
+        auto const newline = _mm256_set1_epi8('\n');
+        for (; i + 32 <= size; i += 32) {
+            auto const chunk = _mm256_loadu_si256(reinterpret_cast<__m256i const*>(data + i));
+            auto const mask = static_cast<std::uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(chunk, newline)));
+            push_line_starts(m_line_starts, i, mask);
+        }
+    #elif defined(__SSE2__)
+        auto const newline = _mm_set1_epi8('\n');
+        for (; i + 16 <= size; i += 16) {
+            auto const chunk = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + i));
+            auto const mask = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)));
+            push_line_starts(m_line_starts, i, mask);
+        }
+    #endif
+
+        for (; i < size; ++i) {
+            if (data[i] == '\n') m_line_starts.push_back(static_cast<offset_type>(i + 1));
+        }
+    }
+
+    auto LineTable::lookup(offset_type offset) const noexcept -> Location {
+        auto const size = m_line_starts.size();
+        auto const contains = [&](offset_type line) {
+            return line < size
+                && m_line_starts[line] <= offset
+                && (line + 1 == size || offset < m_line_starts[line + 1]);
+        };
+
+        auto line = m_last_line.load(std::memory_order_relaxed);
+        if (!contains(line)) {
+            if (contains(line + 1)) {
+                ++line;
+            } else {
+                auto it = std::upper_bound(m_line_starts.begin(), m_line_starts.end(), offset);
+                line = static_cast<offset_type>(it - m_line_starts.begin() - 1);
+            }
+            m_last_line.store(line, std::memory_order_relaxed);
+        }
+
+        return { .line = line, .column = offset - m_line_starts[line] };
+    }
+
+} // namespace dark
@@ -4,10 +4,13 @@
 #include "diagnostics/diagnostic_emitter.hpp"
 #include "diagnostics/dianostic_converter.hpp"
 #include <cstddef>
+#include <cstdint>
+#include <cstring>
 #include <limits>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/Support/VirtualFileSystem.h>
 #include <llvm/Support/ErrorOr.h>
+#include <llvm/Support/Process.h>
 
 namespace dark {
 
@@ -29,7 +32,8 @@ namespace dark {
     auto SourceBuffer::make_from_file(
             llvm::vfs::FileSystem& fs,
             llvm::StringRef filename,
-            DiagnosticConsumer& consumer
+            DiagnosticConsumer& consumer,
+            LoadMode mode
         ) -> std::optional<SourceBuffer> {
         
         auto converter = FilenameConverter{};
@@ -53,7 +57,11 @@ namespace dark {
         auto size = status->getSize();
         
         return make_from_memory_buffer(
-            (*file)->getBuffer(filename, size, /*RequiresNullTerminator=*/false),
+            // Requiring a null terminator keeps LLVM from mapping files whose size is
+            // page-aligned, since nothing would follow them in the mapping. Marking
+            // the file volatile keeps it from mapping any file, which `Buffered`
+            // needs: otherwise a mapping with enough slack would be kept as is.
+            (*file)->getBuffer(filename, size, /*RequiresNullTerminator=*/true, /*IsVolatile=*/mode == LoadMode::Buffered),
             filename,
             is_regular_file,
             consumer
@@ -76,16 +84,60 @@ namespace dark {
         }
 
         if (buffer.get()->getBufferSize() >= std::numeric_limits<IdBase::inner_type>::max()) {
-            DARK_DIAGNOSTIC(FileTooLarge, Error, "File is over the 2GiB input limit; size is {0} bytes.", std::size_t);
-            emitter.emit(filename, FileTooLarge, buffer.get()->getBufferSize());
+            DARK_DIAGNOSTIC(FileTooLarge, Error, "File is over the {0}-byte input limit; size is {1} bytes.", std::size_t, std::size_t);
+            auto builder = emitter.build(filename, FileTooLarge, static_cast<std::size_t>(std::numeric_limits<IdBase::inner_type>::max()), buffer.get()->getBufferSize());
+        #ifndef DARK_WIDE_SOURCE_OFFSETS
+            builder.add_note_suggestion("Configure with DARK_WIDE_SOURCE_OFFSETS=ON to lex larger inputs.");
+        #endif
+            builder.emit();
+            return std::nullopt;
+        }
+
+        auto const size = buffer.get()->getBufferSize();
+        auto source = ensure_padding(std::move(buffer.get()));
+        if (!source) {
+            DARK_DIAGNOSTIC(ErrorReadingFile, Error, "Error reading file: {0}", std::string);
+            emitter.emit(filename, ErrorReadingFile, std::string("unable to allocate the padded source buffer"));
             return std::nullopt;
         }
 
         return SourceBuffer(
             filename.str(),
-            std::move(buffer.get()),
+            std::move(source),
+            size,
             is_regular_file
         );
     }
 
+    auto SourceBuffer::get_line_table() const -> LineTable const& {
+        std::call_once(m_line_table->once, [this] {
+            m_line_table->table = LineTable(get_source());
+        });
+        return m_line_table->table;
+    }
+
+    auto SourceBuffer::set_line_table(LineTable table) const -> void {
+        std::call_once(m_line_table->once, [this, &table] {
+            m_line_table->table = std::move(table);
+        });
+    }
+
+    auto SourceBuffer::ensure_padding(std::unique_ptr<llvm::MemoryBuffer> buffer) -> std::unique_ptr<llvm::MemoryBuffer> {
+        if (buffer->getBufferKind() == llvm::MemoryBuffer::MemoryBuffer_MMap) {
+            // The kernel zero-fills the remainder of the last mapped page.
+            auto const page_size = static_cast<std::uintptr_t>(llvm::sys::Process::getPageSizeEstimate());
+            auto const end = reinterpret_cast<std::uintptr_t>(buffer->getBufferEnd());
+            auto const slack = (page_size - end % page_size) % page_size;
+            if (slack >= padding) return buffer;
+        }
+
+        auto const size = buffer->getBufferSize();
+        auto copy = llvm::WritableMemoryBuffer::getNewUninitMemBuffer(size + padding, buffer->getBufferIdentifier());
+        if (!copy) return nullptr;
+
+        std::memcpy(copy->getBufferStart(), buffer->getBufferStart(), size);
+        std::memset(copy->getBufferStart() + size, 0, padding);
+        return copy;
+    }
+
 } // namespace dark
\ No newline at end of file
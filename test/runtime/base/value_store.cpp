@@ -0,0 +1,196 @@
+#include <catch2/catch_test_macros.hpp>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "base/string_interner.hpp"
+#include "base/value_store.hpp"
+
+using namespace dark;
+
+TEST_CASE("String Store", "[value_store]") {
+    SECTION("Interning") {
+        auto store = ValueStore<StringId>();
+        auto const a = store.add_borrowed("alpha");
+        auto const b = store.add_borrowed("beta");
+        REQUIRE(a.index == 0);
+        REQUIRE(b.index == 1);
+        REQUIRE(store.add_borrowed("alpha").index == a.index);
+        REQUIRE(store.get(b) == "beta");
+        REQUIRE(store.find("beta").index == b.index);
+        REQUIRE(!store.find("gamma").is_valid());
+        REQUIRE(store.size() == 2);
+    }
+
+    SECTION("Owned strings are copied") {
+        auto store = ValueStore<StringId>();
+        auto id = StringId::invalid;
+        {
+            auto value = std::string(64, 'x');
+            id = store.add(CowString::make_owned(value));
+            value.assign(64, 'y');
+        }
+        REQUIRE(store.get(id) == std::string(64, 'x'));
+    }
+
+    SECTION("Borrowed strings are not copied") {
+        auto store = ValueStore<StringId>();
+        auto const source = std::string("borrowed");
+        auto const id = store.add_borrowed(source);
+        REQUIRE(store.get(id).data() == source.data());
+    }
+
+    SECTION("Strings larger than an arena block") {
+        auto store = ValueStore<StringId>();
+        auto const small = store.add(CowString::make_owned(std::string(10, 'a')));
+        auto const large = store.add(CowString::make_owned(std::string(3u << 20, 'b')));
+        auto const empty = store.add(CowString::make_owned(std::string()));
+        REQUIRE(store.get(small) == std::string(10, 'a'));
+        REQUIRE(store.get(large) == std::string(3u << 20, 'b'));
+        REQUIRE(store.get(empty).empty());
+    }
+
+    SECTION("One shard past many arena blocks") {
+        // Hashes with the top byte cleared all land in the first shard.
+        auto const hash = [](std::string_view value) { return StringInterner::hash(value) >> 8; };
+
+        auto interner = StringInterner();
+        auto small = std::vector<std::string>();
+        auto small_ids = std::vector<std::size_t>();
+        for (auto i = 0u; i < (4u << 20) / 64; ++i) {
+            small.push_back(std::to_string(i) + std::string(60, 's'));
+            small_ids.push_back(interner.intern(small.back(), hash(small.back()), true));
+        }
+
+        // More strings of over half a 1 MiB block than a 27-bit offset has
+        // blocks for.
+        auto large = std::string((1u << 19) + 1, 'l');
+        auto large_ids = std::vector<std::size_t>();
+        for (auto i = 0u; i < 160; ++i) {
+            std::memcpy(large.data(), &i, sizeof(i));
+            large_ids.push_back(interner.intern(large, hash(large), true));
+        }
+
+        REQUIRE(interner.size() == small.size() + large_ids.size());
+        for (auto i = 0u; i < small.size(); ++i) {
+            REQUIRE(interner.get(small_ids[i]) == small[i]);
+        }
+        for (auto i = 0u; i < large_ids.size(); ++i) {
+            std::memcpy(large.data(), &i, sizeof(i));
+            REQUIRE(interner.get(large_ids[i]) == large);
+        }
+    }
+
+    SECTION("Concurrent interning") {
+        constexpr auto thread_count = 8u;
+        constexpr auto word_count = 20000u;
+
+        auto words = std::vector<std::string>();
+        for (auto i = 0u; i < word_count; ++i) {
+            words.push_back("word" + std::to_string(i));
+        }
+
+        auto store = ValueStore<StringId>();
+        auto ids = std::vector<std::vector<StringId>>(thread_count);
+        auto threads = std::vector<std::thread>();
+        for (auto t = 0u; t < thread_count; ++t) {
+            threads.emplace_back([&, t] {
+                // Every thread interns every word, starting at a different offset.
+                for (auto i = 0u; i < word_count; ++i) {
+                    ids[t].push_back(store.add_borrowed(words[(i + t * 997u) % word_count]));
+                }
+            });
+        }
+        for (auto& thread: threads) thread.join();
+
+        REQUIRE(store.size() == word_count);
+        for (auto t = 0u; t < thread_count; ++t) {
+            for (auto i = 0u; i < word_count; ++i) {
+                REQUIRE(store.get(ids[t][i]) == words[(i + t * 997u) % word_count]);
+            }
+        }
+    }
+}
+
+TEST_CASE("Int Store", "[value_store]") {
+    SECTION("Small integers are embedded in the id") {
+        auto store = ValueStore<IntId>();
+        auto const zero = store.add(llvm::APInt(2, 0));
+        auto const small = store.add(llvm::APInt(64, (1u << IntId::embedded_bits) - 1));
+        REQUIRE(zero.is_embedded());
+        REQUIRE(small.is_embedded());
+        REQUIRE(zero.is_valid());
+        REQUIRE(store.get(zero) == 0);
+        REQUIRE(store.get(small) == (1u << IntId::embedded_bits) - 1);
+        REQUIRE(store.size() == 0);
+    }
+
+    SECTION("Large integers are stored") {
+        auto store = ValueStore<IntId>();
+        auto const large = store.add(llvm::APInt(64, std::uint64_t{ 1 } << IntId::embedded_bits));
+        auto const negative = store.add(llvm::APInt(8, -1, /*isSigned=*/true));
+        REQUIRE(!large.is_embedded());
+        REQUIRE(!negative.is_embedded());
+        REQUIRE(store.get(large) == std::uint64_t{ 1 } << IntId::embedded_bits);
+        REQUIRE(store.get(negative).to_apint().isAllOnes());
+        REQUIRE(store.size() == 2);
+    }
+
+    SECTION("Views convert back to APInt") {
+        auto store = ValueStore<IntId>();
+        auto const id = store.add(llvm::APInt(8, 42));
+        auto const value = store.get(id).to_apint();
+        REQUIRE(value == 42);
+        REQUIRE(value.isNonNegative());
+        REQUIRE(store.add(store.get(id)).index == id.index);
+    }
+
+    SECTION("Stored integers are deduplicated") {
+        auto store = ValueStore<IntId>();
+        auto const value = llvm::APInt(64, std::uint64_t{ 1 } << 40);
+        auto const first = store.add(value);
+        for (auto i = 0; i < 100; ++i) {
+            REQUIRE(store.add(llvm::APInt(value)).index == first.index);
+        }
+        REQUIRE(store.add(llvm::APInt(64, (std::uint64_t{ 1 } << 40) + 1)).index != first.index);
+        REQUIRE(store.size() == 2);
+    }
+}
+
+TEST_CASE("Real Store", "[value_store]") {
+    auto const make_real = [](std::uint64_t mantissa, std::uint64_t exponent, bool is_decimal) {
+        auto real = Real();
+        real.mantissa = llvm::APInt(16, mantissa);
+        real.exponent = llvm::APInt(16, exponent);
+        real.is_decimal = is_decimal;
+        return real;
+    };
+
+    auto store = ValueStore<RealId>();
+    auto const first = store.add(make_real(15, 1, true));
+    REQUIRE(store.add(make_real(15, 1, true)).index == first.index);
+    REQUIRE(store.add(make_real(15, 1, false)).index != first.index);
+    REQUIRE(store.add(make_real(15, 2, true)).index != first.index);
+    REQUIRE(store.emplace(make_real(15, 1, true)).index == first.index);
+    REQUIRE(store.size() == 3);
+
+    SECTION("Doubles are stored apart from reals") {
+        auto const half = store.add(0.5);
+        REQUIRE(half.is_double());
+        REQUIRE(store.add(0.5).index == half.index);
+        REQUIRE(store.add(0.25).index != half.index);
+        REQUIRE(store.get(half).get_double() == 0.5);
+        REQUIRE(store.add(store.get(half)).index == half.index);
+        REQUIRE(store.array_ref().size() == 3);
+        REQUIRE(store.double_array_ref().size() == 2);
+        REQUIRE(store.size() == 5);
+    }
+
+    SECTION("Reals convert to the nearest double") {
+        REQUIRE(store.get(first).to_double() == 150.0);
+        REQUIRE(store.get(store.add(make_real(15, 1, false))).to_double() == 30.0);
+    }
+}
@@ -0,0 +1,48 @@
+#include <catch2/catch_test_macros.hpp>
+#include <llvm/ADT/APInt.h>
+#include <llvm/ADT/StringRef.h>
+#include <cstdint>
+#include <limits>
+#include "common/real_conversion.hpp"
+
+using namespace dark;
+
+TEST_CASE("Real Conversion Test", "[real_conversion]") {
+    SECTION("Decimal reals round to nearest") {
+        REQUIRE(decimal_to_double(1, -1) == 0.1);
+        REQUIRE(decimal_to_double(15, -1) == 1.5);
+        REQUIRE(decimal_to_double(17976931348623157, 292) == std::numeric_limits<double>::max());
+        REQUIRE(decimal_to_double(22250738585072014, -324) == std::numeric_limits<double>::min());
+        REQUIRE(decimal_to_double(5, -324) == std::numeric_limits<double>::denorm_min());
+        REQUIRE(decimal_to_double(2, -324) == 0.0);
+        REQUIRE(decimal_to_double(1, 309) == std::numeric_limits<double>::infinity());
+        REQUIRE(decimal_to_double(0, 400) == 0.0);
+    }
+
+    SECTION("Ties round to even") {
+        // 2^53 + 1 and 2^53 + 3 are halfway between two doubles.
+        REQUIRE(decimal_to_double(9007199254740993, 0) == 9007199254740992.0);
+        REQUIRE(decimal_to_double(9007199254740995, 0) == 9007199254740996.0);
+    }
+
+    SECTION("Wide mantissas and exponents") {
+        auto const mantissa = llvm::APInt(128, llvm::StringRef("123456789012345678901234567890"), 10);
+        REQUIRE(decimal_to_double(mantissa, llvm::APInt(8, -29, /*isSigned=*/true)) == 1.2345678901234568);
+        REQUIRE(decimal_to_double(llvm::APInt(8, 1), llvm::APInt(128, llvm::StringRef("100000000000000000000"), 10)) == std::numeric_limits<double>::infinity());
+        REQUIRE(binary_to_double(llvm::APInt(128, llvm::StringRef("20000000000000001"), 16), llvm::APInt(8, -65, /*isSigned=*/true)) == 1.0);
+    }
+
+    SECTION("Only exact values convert exactly") {
+        REQUIRE(exact_decimal_to_double(15, -1) == 1.5);
+        REQUIRE(exact_decimal_to_double(3, 8) == 3.0e8);
+        REQUIRE(exact_decimal_to_double(1, 22) == 1.0e22);
+        REQUIRE(!exact_decimal_to_double(1, 23));
+        REQUIRE(!exact_decimal_to_double(1, -1));
+        REQUIRE(!exact_decimal_to_double(9007199254740993, 0));
+        REQUIRE(exact_binary_to_double(3, -1) == 1.5);
+        REQUIRE(exact_binary_to_double(1, -1074) == std::numeric_limits<double>::denorm_min());
+        REQUIRE(!exact_binary_to_double(1, -1075));
+        REQUIRE(!exact_binary_to_double(1, 1024));
+        REQUIRE(!exact_binary_to_double((std::uint64_t{ 1 } << 53) + 1, 0));
+    }
+}
@@ -0,0 +1,52 @@
+#include <catch2/catch_test_macros.hpp>
+#include <string>
+#include "common/utf8.hpp"
+
+using namespace dark;
+
+TEST_CASE("UTF-8 Cursor", "[utf8]") {
+    SECTION("Decoding") {
+        REQUIRE(utf8::decode("a").code_point == U'a');
+        REQUIRE(utf8::decode("a").length == 1);
+        REQUIRE(utf8::decode("é").code_point == U'é');
+        REQUIRE(utf8::decode("é").length == 2);
+        REQUIRE(utf8::decode("€").code_point == U'€');
+        REQUIRE(utf8::decode("€").length == 3);
+        REQUIRE(utf8::decode("\U0001F600").code_point == U'\U0001F600');
+        REQUIRE(utf8::decode("\U0001F600").length == 4);
+
+        // Only the first code point is decoded.
+        REQUIRE(utf8::decode("éabc").length == 2);
+
+        REQUIRE(utf8::decode("").length == 0);
+        REQUIRE(utf8::decode("\x80").length == 0);
+        REQUIRE(utf8::decode("\xc3").length == 0);
+        REQUIRE(utf8::decode("\xc3\x28").length == 0);
+        REQUIRE(utf8::decode("\xc0\xaf").length == 0);
+        REQUIRE(utf8::decode("\xed\xa0\x80").length == 0);
+        REQUIRE(utf8::decode("\xf4\x90\x80\x80").length == 0);
+        REQUIRE(utf8::decode("\xf8\x90\x80\x80").length == 0);
+    }
+
+    SECTION("Validated next") {
+        auto text = std::string("aé\xff");
+        auto cursor = utf8::Utf8Cursor(text);
+        REQUIRE(cursor.next() == U'a');
+        REQUIRE(cursor.next() == U'é');
+        REQUIRE(cursor.position() == 3);
+        REQUIRE(!cursor.next().has_value());
+        REQUIRE(cursor.position() == 3);
+    }
+
+    SECTION("Skipping ASCII") {
+        for (auto size: { 0zu, 5zu, 31zu, 32zu, 63zu, 64zu, 100zu, 200zu }) {
+            auto text = std::string(size, 'x') + "é" + std::string(70, 'y');
+            auto cursor = utf8::Utf8Cursor(text);
+            cursor.skip_ascii();
+            REQUIRE(cursor.position() == size);
+            REQUIRE(cursor.next() == U'é');
+            cursor.skip_ascii();
+            REQUIRE(cursor.is_end());
+        }
+    }
+}
@@ -0,0 +1,606 @@
+#include <catch2/catch_test_macros.hpp>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/VirtualFileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <array>
+#include <cstddef>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <string>
+#include "base/value_store.hpp"
+#include "lexer/lexer.hpp"
+#include "lexer/token_buffer.hpp"
+#include "lexer/token_kind.hpp"
+#include "lexer/token_snapshot.hpp"
+#include "source/source_buffer.hpp"
+#include "./mock.hpp"
+
+using namespace dark;
+using namespace dark::lexer;
+
+struct LexerMock {
+    auto load(llvm::StringRef text) -> SourceBuffer& {
+        auto filename = "test_" + std::to_string(sources.size()) + ".dark";
+        fs.addFile(filename, 0, llvm::MemoryBuffer::getMemBufferCopy(text));
+        auto source = SourceBuffer::make_from_file(fs, filename, consumer);
+        REQUIRE(source.has_value());
+        sources.push_back(std::make_unique<SourceBuffer>(std::move(*source)));
+        return *sources.back();
+    }
+
+    auto lex(llvm::StringRef text) -> TokenizedBuffer {
+        return Lexer::lex(load(text), value_stores, consumer);
+    }
+
+    auto lex_lazy(llvm::StringRef text) -> TokenizedBuffer {
+        return Lexer::lex(load(text), value_stores, consumer, Lexer::LiteralMode::Lazy);
+    }
+
+    auto lex_parallel(llvm::StringRef text, std::size_t chunk_size, Lexer::LiteralMode literal_mode = Lexer::LiteralMode::Eager) -> TokenizedBuffer {
+        return Lexer::lex_parallel(load(text), value_stores, consumer, 4, chunk_size, literal_mode);
+    }
+
+    static auto to_string(TokenizedBuffer const& buffer) -> std::string {
+        auto result = std::string();
+        auto os = llvm::raw_string_ostream(result);
+        buffer.print(os);
+        return os.str();
+    }
+
+    static auto has_kinds(TokenizedBuffer const& buffer, std::initializer_list<TokenKind> kinds) -> bool {
+        if (buffer.size() != kinds.size()) return false;
+        auto it = kinds.begin();
+        for (auto token: buffer.tokens()) {
+            if (buffer.get_kind(token) != *it++) return false;
+        }
+        return true;
+    }
+
+    // Both mocks reported the same diagnostics, in the same order and at the
+    // same places.
+    static auto expect_same_diagnostics(LexerMock const& actual, LexerMock const& expected) -> void {
+        REQUIRE(actual.consumer.diagnostics.size() == expected.consumer.diagnostics.size());
+        for (auto i = std::size_t{}; i < expected.consumer.diagnostics.size(); ++i) {
+            auto const& lhs = actual.consumer.diagnostics[i].collections[0];
+            auto const& rhs = expected.consumer.diagnostics[i].collections[0];
+            REQUIRE(lhs.kind == rhs.kind);
+            REQUIRE(lhs.messages[0].location.line_number == rhs.messages[0].location.line_number);
+            REQUIRE(lhs.messages[0].location.column_number == rhs.messages[0].location.column_number);
+        }
+    }
+
+    llvm::vfs::InMemoryFileSystem fs;
+    SharedValueStores value_stores;
+    MockDiagnosticConsumer consumer;
+    llvm::SmallVector<std::unique_ptr<SourceBuffer>> sources;
+};
+
+TEST_CASE("Lexer", "[lexer]") {
+    SECTION("Empty Source") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex("");
+        REQUIRE(!buffer.has_error());
+        REQUIRE(LexerMock::has_kinds(buffer, { TokenKind::FileStart, TokenKind::FileEnd }));
+    }
+
+    SECTION("Symbols And Identifiers") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex("rule =:: a..=b | c* ;");
+        REQUIRE(!buffer.has_error());
+        REQUIRE(LexerMock::has_kinds(buffer, {
+            TokenKind::FileStart,
+            TokenKind::Identifier,
+            TokenKind::ebnf_EqualColonColon,
+            TokenKind::Identifier,
+            TokenKind::ebnf_RangeInclusive,
+            TokenKind::Identifier,
+            TokenKind::ebnf_Or,
+            TokenKind::Identifier,
+            TokenKind::ebnf_ZeroOrMore,
+            TokenKind::ebnf_Semicolon,
+            TokenKind::FileEnd
+        }));
+
+        auto it = buffer.tokens().begin() + 1;
+        REQUIRE(buffer.get_token_text(*it) == "rule");
+        REQUIRE(buffer.has_trailing_whitespace(*it));
+        REQUIRE(buffer.get_column_number(*(it + 1)) == 6);
+        REQUIRE(buffer.get_token_text(*(it + 2)) == "a");
+        REQUIRE(!buffer.has_trailing_whitespace(*(it + 2)));
+    }
+
+    SECTION("Keywords") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex("import imports");
+        REQUIRE(LexerMock::has_kinds(buffer, {
+            TokenKind::FileStart,
+            TokenKind::ebnf_Import,
+            TokenKind::Identifier,
+            TokenKind::FileEnd
+        }));
+
+        for (auto kind: TokenKind::keyword_tokens) {
+            REQUIRE(TokenKind::from_keyword_spelling(kind.fixed_spelling()) == kind);
+        }
+        REQUIRE(TokenKind::from_keyword_spelling("").is_error());
+        REQUIRE(TokenKind::from_keyword_spelling("impor").is_error());
+        REQUIRE(TokenKind::from_keyword_spelling("imports").is_error());
+    }
+
+    SECTION("Lines And Indentation") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex("a\n    b\n\n  c");
+        auto it = buffer.tokens().begin() + 1;
+        REQUIRE(buffer.get_line_number(*it) == 1);
+        REQUIRE(buffer.get_line_number(*(it + 1)) == 2);
+        REQUIRE(buffer.get_column_number(*(it + 1)) == 5);
+        REQUIRE(buffer.get_indent_column_number(buffer.get_line(*(it + 1))) == 5);
+        REQUIRE(buffer.get_indent_column_number(buffer.get_next_line(buffer.get_line(*(it + 1)))) == 1);
+        REQUIRE(buffer.get_line_number(*(it + 2)) == 4);
+        REQUIRE(buffer.get_column_number(*(it + 2)) == 3);
+    }
+
+    SECTION("Literals") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex(R"(42 1.5 "hello")");
+        REQUIRE(!buffer.has_error());
+        REQUIRE(LexerMock::has_kinds(buffer, {
+            TokenKind::FileStart,
+            TokenKind::IntegerLiteral,
+            TokenKind::RealLiteral,
+            TokenKind::StringLiteral,
+            TokenKind::FileEnd
+        }));
+
+        auto it = buffer.tokens().begin() + 1;
+        REQUIRE(mock.value_stores.ints().get(buffer.get_int_literal(*it)) == 42);
+        REQUIRE(buffer.get_token_text(*it) == "42");
+        REQUIRE(buffer.get_token_text(*(it + 1)) == "1.5");
+        REQUIRE(mock.value_stores.string_literal().get(buffer.get_string_literal(*(it + 2))) == "hello");
+    }
+
+    SECTION("Numeric Literals Past 64 Bits") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex("18_446_744_073_709_551_615 18_446_744_073_709_551_616 0x1_0000_0000_0000_0000 2.5e-3 1.0e99999999999999999999");
+        REQUIRE(!buffer.has_error());
+
+        auto it = buffer.tokens().begin() + 1;
+        auto const int_text = [&](auto token) {
+            auto text = llvm::SmallString<32>();
+            mock.value_stores.ints().get(buffer.get_int_literal(token)).to_apint().toString(text, 10, /*Signed=*/true);
+            return std::string(text);
+        };
+        REQUIRE(int_text(*it) == "18446744073709551615");
+        REQUIRE(int_text(*(it + 1)) == "18446744073709551616");
+        REQUIRE(int_text(*(it + 2)) == "18446744073709551616");
+
+        auto const& small = mock.value_stores.reals().get(buffer.get_real_literal(*(it + 3))).get_real();
+        REQUIRE(small.mantissa.getSExtValue() == 25);
+        REQUIRE(small.exponent.getSExtValue() == -4);
+        REQUIRE(small.is_decimal);
+
+        auto const& large = mock.value_stores.reals().get(buffer.get_real_literal(*(it + 4))).get_real();
+        auto exponent = llvm::SmallString<32>();
+        large.exponent.toString(exponent, 10, /*Signed=*/true);
+        REQUIRE(large.mantissa.getSExtValue() == 10);
+        REQUIRE(exponent == "99999999999999999998");
+    }
+
+    SECTION("Exact Reals Are Stored As Doubles") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex("1.5 3.0e8 0x1.8p1 0.1 1.0e400 1.5");
+        REQUIRE(!buffer.has_error());
+
+        auto const get = [&](std::size_t index) {
+            return mock.value_stores.reals().get(buffer.get_real_literal(*(buffer.tokens().begin() + 1 + index)));
+        };
+        REQUIRE(get(0).is_double());
+        REQUIRE(get(0).get_double() == 1.5);
+        REQUIRE(get(1).is_double());
+        REQUIRE(get(1).get_double() == 3.0e8);
+        REQUIRE(get(2).is_double());
+        REQUIRE(get(2).get_double() == 3.0);
+
+        // Neither is a double, so both keep their exact value.
+        REQUIRE(!get(3).is_double());
+        REQUIRE(get(3).to_double() == 0.1);
+        REQUIRE(!get(4).is_double());
+        REQUIRE(get(4).to_double() == std::numeric_limits<double>::infinity());
+
+        REQUIRE(buffer.get_real_literal(*(buffer.tokens().begin() + 6)).index == buffer.get_real_literal(*(buffer.tokens().begin() + 1)).index);
+        REQUIRE(mock.value_stores.reals().size() == 5);
+    }
+
+    SECTION("Digit Separators") {
+        auto const lexes_cleanly = [](llvm::StringRef text) {
+            auto mock = LexerMock();
+            return !mock.lex(text).has_error();
+        };
+
+        REQUIRE(lexes_cleanly("1_234_567_890_123"));
+        REQUIRE(lexes_cleanly("0xdead_beef_CAFE_f00d"));
+        REQUIRE(lexes_cleanly("0b1010_1_10"));
+        REQUIRE(lexes_cleanly("12_345.678_9e1_000") == false);
+        REQUIRE(lexes_cleanly("1_2345_678") == false);
+        REQUIRE(lexes_cleanly("1__234") == false);
+        REQUIRE(lexes_cleanly("12345678_") == false);
+        REQUIRE(lexes_cleanly("1234_5678") == false);
+        REQUIRE(lexes_cleanly("12345678a") == false);
+
+        // Separators in the first and last byte of an eight-byte word.
+        REQUIRE(lexes_cleanly("0x123_4567_89AB_CDEF"));
+        REQUIRE(lexes_cleanly("0x123_4567_89AB_CDEF_0123_4567"));
+        REQUIRE(lexes_cleanly("123_456_789_012_345"));
+        REQUIRE(lexes_cleanly("0x_1234567") == false);
+        REQUIRE(lexes_cleanly("0b_10101010") == false);
+        REQUIRE(lexes_cleanly("0x1234567_") == false);
+
+        // Past the 64 bytes the scan records separators for.
+        auto long_digits = std::string("1");
+        for (auto i = 0; i < 23; ++i) long_digits += "_000";
+        REQUIRE(lexes_cleanly(long_digits));
+        REQUIRE(lexes_cleanly(long_digits + "_") == false);
+    }
+
+    SECTION("Non-ASCII Source") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex("a \"h\u00e9llo\" b");
+        REQUIRE(!buffer.has_error());
+        REQUIRE(!mock.sources.back()->is_ascii());
+        REQUIRE(LexerMock::has_kinds(buffer, {
+            TokenKind::FileStart,
+            TokenKind::Identifier,
+            TokenKind::StringLiteral,
+            TokenKind::Identifier,
+            TokenKind::FileEnd
+        }));
+        auto it = buffer.tokens().begin() + 2;
+        REQUIRE(mock.value_stores.string_literal().get(buffer.get_string_literal(*it)) == "h\u00e9llo");
+        REQUIRE(buffer.get_column_number(*(it + 1)) == 12);
+    }
+
+    SECTION("Unicode Identifiers") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex("h\u00e9llo \u0394x\u0301 \u2192");
+        REQUIRE(LexerMock::has_kinds(buffer, {
+            TokenKind::FileStart,
+            TokenKind::Identifier,
+            TokenKind::Identifier,
+            TokenKind::Error,
+            TokenKind::FileEnd
+        }));
+        auto it = buffer.tokens().begin() + 1;
+        REQUIRE(buffer.get_token_text(*it) == "h\u00e9llo");
+        REQUIRE(buffer.get_token_text(*(it + 1)) == "\u0394x\u0301");
+    }
+
+    SECTION("Multi-line String Literal") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex("a \"\"\"\n  text\n  \"\"\" b");
+        auto it = buffer.tokens().begin() + 1;
+        REQUIRE(buffer.get_kind(*(it + 1)) == TokenKind::StringLiteral);
+        REQUIRE(buffer.get_line_number(*(it + 1)) == 1);
+        REQUIRE(buffer.get_token_text(*(it + 1)) == "\"\"\"\n  text\n  \"\"\"");
+        auto [end_line, end_column] = buffer.get_end_loc(*(it + 1));
+        REQUIRE(buffer.get_line_number(end_line) == 3);
+        REQUIRE(end_column == 6);
+        REQUIRE(buffer.get_kind(*(it + 2)) == TokenKind::Identifier);
+        REQUIRE(buffer.get_line_number(*(it + 2)) == 3);
+    }
+
+    SECTION("Grouping Symbols") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex("( [ a ] { } )");
+        REQUIRE(!buffer.has_error());
+        auto open_paren = *(buffer.tokens().begin() + 1);
+        auto open_bracket = *(buffer.tokens().begin() + 2);
+        auto close_paren = *(buffer.tokens().begin() + 7);
+        REQUIRE(buffer.get_matched_closing_token(open_paren).index == close_paren.index);
+        REQUIRE(buffer.get_matched_opening_token(close_paren).index == open_paren.index);
+        REQUIRE(buffer.get_kind(buffer.get_matched_closing_token(open_bracket)) == TokenKind::CloseBracket);
+    }
+
+    SECTION("Mismatched Grouping Symbols") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex("( [ )");
+        REQUIRE(buffer.has_error());
+        REQUIRE(LexerMock::has_kinds(buffer, {
+            TokenKind::FileStart,
+            TokenKind::OpenParen,
+            TokenKind::OpenBracket,
+            TokenKind::CloseBracket,
+            TokenKind::CloseParen,
+            TokenKind::FileEnd
+        }));
+        REQUIRE(buffer.is_recovery_token(*(buffer.tokens().begin() + 3)));
+        REQUIRE(!buffer.is_recovery_token(*(buffer.tokens().begin() + 4)));
+        REQUIRE(mock.consumer.diagnostics.size() == 1);
+        REQUIRE(mock.consumer.diagnostics[0].collections[0].kind == DiagnosticKind::MismatchedClosing);
+    }
+
+    SECTION("Unmatched Grouping Symbols") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex(") (");
+        REQUIRE(buffer.has_error());
+        REQUIRE(LexerMock::has_kinds(buffer, {
+            TokenKind::FileStart,
+            TokenKind::Error,
+            TokenKind::OpenParen,
+            TokenKind::CloseParen,
+            TokenKind::FileEnd
+        }));
+        REQUIRE(mock.consumer.diagnostics.size() == 2);
+        REQUIRE(mock.consumer.diagnostics[0].collections[0].kind == DiagnosticKind::UnmatchedClosing);
+        REQUIRE(mock.consumer.diagnostics[1].collections[0].kind == DiagnosticKind::UnmatchedOpening);
+    }
+
+    SECTION("Comments") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex("// comment\na");
+        REQUIRE(!buffer.has_error());
+        REQUIRE(LexerMock::has_kinds(buffer, { TokenKind::FileStart, TokenKind::Identifier, TokenKind::FileEnd }));
+
+        buffer = mock.lex("a // comment");
+        REQUIRE(buffer.has_error());
+        REQUIRE(mock.consumer.diagnostics.back().collections[0].kind == DiagnosticKind::TrailingComment);
+    }
+
+    SECTION("Unrecognized Characters") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex("a @@ b");
+        REQUIRE(buffer.has_error());
+        REQUIRE(LexerMock::has_kinds(buffer, {
+            TokenKind::FileStart,
+            TokenKind::Identifier,
+            TokenKind::Error,
+            TokenKind::Identifier,
+            TokenKind::FileEnd
+        }));
+        REQUIRE(buffer.get_token_text(*(buffer.tokens().begin() + 2)) == "@@");
+    }
+
+    SECTION("Parallel Lexing Matches Serial Lexing") {
+        // Tiny chunks put boundaries inside multi-line strings, open groups and
+        // error recovery.
+        auto const text = llvm::StringRef(
+            "rule = ( a | \"x\" ) ;\n"
+            "doc = \"\"\"\n  first\n  second\n  \"\"\" b ;\n"
+            "list = [ 1 , 2.5 , \"\\q\" ,\n  c ] ;\n"
+            "bad = ( [ ) @@ ;\n"
+            "// comment\n"
+            "  x // trailing\n"
+            "d \"\u00e9t\u00e9\" ) { e\n"
+            "\"\"\"\nunterminated\n"
+        );
+
+        for (auto chunk_size: { std::size_t{ 1 }, std::size_t{ 7 }, std::size_t{ 16 }, std::size_t{ 64 } }) {
+            auto serial = LexerMock();
+            auto parallel = LexerMock();
+            auto expected = serial.lex(text);
+            auto actual = parallel.lex_parallel(text, chunk_size);
+
+            REQUIRE(LexerMock::to_string(actual) == LexerMock::to_string(expected));
+            REQUIRE(actual.has_error() == expected.has_error());
+            REQUIRE(actual.expected_parse_tree_size() == expected.expected_parse_tree_size());
+            REQUIRE(parallel.value_stores.strings().size() == serial.value_stores.strings().size());
+            REQUIRE(parallel.value_stores.ints().size() == serial.value_stores.ints().size());
+            REQUIRE(parallel.value_stores.reals().size() == serial.value_stores.reals().size());
+
+            LexerMock::expect_same_diagnostics(parallel, serial);
+        }
+    }
+
+    SECTION("Lazy Literals") {
+        auto mock = LexerMock();
+        auto buffer = mock.lex_lazy(R"(a = 123456789012345678901234567890 0123 "h\u{e9}llo" 0.1 ;)");
+        REQUIRE(mock.consumer.diagnostics.empty());
+        REQUIRE(!buffer.has_error());
+        REQUIRE(buffer.has_pending_literals());
+        REQUIRE(mock.value_stores.ints().size() == 0);
+        REQUIRE(mock.value_stores.reals().size() == 0);
+
+        auto it = buffer.tokens().begin() + 3;
+        REQUIRE(buffer.get_kind(*it) == TokenKind::IntegerLiteral);
+        REQUIRE(buffer.get_kind(*(it + 1)) == TokenKind::IntegerLiteral);
+        REQUIRE(mock.value_stores.string_literal().get(buffer.get_string_literal(*(it + 2))) == "h\u00e9llo");
+        REQUIRE(mock.value_stores.ints().size() == 0);
+
+        // Later reads return the memoized id.
+        auto const id = buffer.get_string_literal(*(it + 2));
+        REQUIRE(buffer.get_string_literal(*(it + 2)).index == id.index);
+
+        // Reading a literal that has no value keeps its kind and holds its
+        // diagnostic back.
+        REQUIRE(!buffer.get_int_literal(*(it + 1)).is_valid());
+        REQUIRE(buffer.get_kind(*(it + 1)) == TokenKind::IntegerLiteral);
+        REQUIRE(!buffer.has_error());
+        REQUIRE(mock.consumer.diagnostics.empty());
+
+        buffer.materialize_all(mock.consumer);
+        REQUIRE(!buffer.has_pending_literals());
+        REQUIRE(buffer.has_error());
+        REQUIRE(mock.consumer.diagnostics.size() == 1);
+        REQUIRE(buffer.get_kind(*(it + 1)) == TokenKind::Error);
+        REQUIRE(mock.value_stores.ints().size() == 1);
+        REQUIRE(mock.value_stores.reals().size() == 1);
+    }
+
+    SECTION("Materializing Lazy Literals Matches Eager Lexing") {
+        // Enough literals for `materialize_all` to split them across threads.
+        auto text = std::string();
+        for (auto i = 0; i < 3000; ++i) {
+            text += "x = " + std::to_string(i * 7919) + " " + std::to_string(i) + ".25e" + std::to_string(i % 400)
+                + " \"s" + std::to_string(i % 50) + "\\t\" 0" + std::to_string(i) + " ;\n";
+        }
+
+        for (auto thread_count: { 1u, 4u }) {
+            auto eager = LexerMock();
+            auto lazy = LexerMock();
+            auto expected = eager.lex(text);
+            auto actual = lazy.lex_lazy(text);
+            actual.materialize_all(lazy.consumer, thread_count);
+
+            REQUIRE(LexerMock::to_string(actual) == LexerMock::to_string(expected));
+            REQUIRE(actual.has_error() == expected.has_error());
+            REQUIRE(actual.expected_parse_tree_size() == expected.expected_parse_tree_size());
+            REQUIRE(lazy.value_stores.ints().size() == eager.value_stores.ints().size());
+            REQUIRE(lazy.value_stores.reals().size() == eager.value_stores.reals().size());
+            REQUIRE(lazy.value_stores.string_literal().size() == eager.value_stores.string_literal().size());
+
+            LexerMock::expect_same_diagnostics(lazy, eager);
+        }
+    }
+
+    SECTION("Batch Literals Match Eager Lexing") {
+        auto const text = llvm::StringRef(
+            "rule = ( a | \"x\" ) ;\n"
+            "n = 0x1F 0b101 0o17 0123 1.5e3 0x1.8p1 0b1.1 ;\n"
+            "doc = \"\"\"\n  first\n  second\n  \"\"\" b ;\n"
+            "list = [ 1 , 2.5 , \"\\q\" ,\n  c ] ;\n"
+            "bad = ( [ ) @@ 12345678901234567890123 ;\n"
+            "d \"\u00e9t\u00e9\" ) { e 09\n"
+        );
+
+        auto serial = LexerMock();
+        auto expected = serial.lex(text);
+
+        auto const check = [&](LexerMock const& mock, TokenizedBuffer const& actual) {
+            REQUIRE(!actual.has_pending_literals());
+            REQUIRE(LexerMock::to_string(actual) == LexerMock::to_string(expected));
+            REQUIRE(actual.has_error() == expected.has_error());
+            REQUIRE(actual.expected_parse_tree_size() == expected.expected_parse_tree_size());
+            REQUIRE(mock.value_stores.ints().size() == serial.value_stores.ints().size());
+            REQUIRE(mock.value_stores.reals().size() == serial.value_stores.reals().size());
+
+            LexerMock::expect_same_diagnostics(mock, serial);
+        };
+
+        {
+            auto batch = LexerMock();
+            auto actual = Lexer::lex(batch.load(text), batch.value_stores, batch.consumer, Lexer::LiteralMode::Batch);
+            check(batch, actual);
+        }
+
+        for (auto chunk_size: { std::size_t{ 1 }, std::size_t{ 7 }, std::size_t{ 64 } }) {
+            auto parallel = LexerMock();
+            auto actual = parallel.lex_parallel(text, chunk_size, Lexer::LiteralMode::Batch);
+            check(parallel, actual);
+        }
+    }
+
+    SECTION("Batch Lexing Matches Sequential Lexing") {
+        auto const texts = std::array<llvm::StringRef, 4>{
+            "a = b | \"s\" ;",
+            "b = 1 2.5 a ;",
+            "c = ( \"s\" \"t\" ] ;",
+            "a c 3 \"t\" ;"
+        };
+
+        auto sequential = LexerMock();
+        auto expected = llvm::SmallVector<std::string>();
+        for (auto text: texts) {
+            expected.push_back(LexerMock::to_string(sequential.lex(text)));
+        }
+
+        auto batch = LexerMock();
+        auto sources = llvm::SmallVector<SourceBuffer*>();
+        for (auto text: texts) {
+            sources.push_back(&batch.load(text));
+        }
+        auto buffers = Lexer::lex_batch(sources, batch.value_stores, batch.consumer, 4);
+
+        REQUIRE(buffers.size() == texts.size());
+        for (auto i = std::size_t{}; i < buffers.size(); ++i) {
+            REQUIRE(LexerMock::to_string(buffers[i]) == expected[i]);
+        }
+        REQUIRE(batch.value_stores.strings().size() == sequential.value_stores.strings().size());
+        REQUIRE(batch.value_stores.ints().size() == sequential.value_stores.ints().size());
+        REQUIRE(batch.value_stores.reals().size() == sequential.value_stores.reals().size());
+        REQUIRE(batch.consumer.diagnostics.size() == sequential.consumer.diagnostics.size());
+        REQUIRE(buffers[2].has_error());
+    }
+
+    SECTION("Snapshots Reload Without Lexing") {
+        auto const text = llvm::StringRef(
+            "rule = ( a | \"x\" | \"\\tq\" ) ;\n"
+            "big = 123456789012345678901234567890 7 ;\n"
+            "real = 2.5 2.5 0.75 ;\n"
+            "a rule [ { } ]\n"
+            // Enough tokens for the bit sections to span more than one word.
+            "x y z x y z x y z x y z x y z x y z x y z x y z x y z x y z ;\n"
+        );
+
+        auto mock = LexerMock();
+        auto expected = mock.lex(text);
+        auto& source = *mock.sources.back();
+        auto image = TokenSnapshot::serialize(expected);
+        REQUIRE(image.has_value());
+
+        auto snapshot = TokenSnapshot::open(llvm::MemoryBuffer::getMemBufferCopy(*image), source);
+        REQUIRE(snapshot.has_value());
+        REQUIRE(snapshot->size() == expected.size());
+        REQUIRE(snapshot->get_kinds()[1] == TokenKind::Identifier);
+        REQUIRE(snapshot->get_line_starts().size() == source.get_line_table().size());
+        REQUIRE(snapshot->int_count() == 1);
+        REQUIRE(snapshot->real_count() == 2);
+
+        auto value_stores = SharedValueStores();
+        auto actual = snapshot->load(source, value_stores);
+        REQUIRE(LexerMock::to_string(actual) == LexerMock::to_string(expected));
+        REQUIRE(actual.expected_parse_tree_size() == expected.expected_parse_tree_size());
+        for (auto token: expected.tokens()) {
+            REQUIRE(actual.has_trailing_whitespace(token) == expected.has_trailing_whitespace(token));
+            REQUIRE(actual.is_recovery_token(token) == expected.is_recovery_token(token));
+        }
+        REQUIRE(value_stores.strings().size() == mock.value_stores.strings().size());
+        REQUIRE(value_stores.ints().size() == mock.value_stores.ints().size());
+        REQUIRE(value_stores.reals().size() == mock.value_stores.reals().size());
+
+        auto& other = mock.load("rule = ( b ) ;");
+        REQUIRE(!TokenSnapshot::open(llvm::MemoryBuffer::getMemBufferCopy(*image), other).has_value());
+
+        auto truncated = image->substr(0, image->size() - 8);
+        REQUIRE(!TokenSnapshot::open(llvm::MemoryBuffer::getMemBufferCopy(truncated), source).has_value());
+    }
+
+    SECTION("Batch Lexing Reuses Snapshots") {
+        auto const texts = std::array<llvm::StringRef, 3>{
+            "a = b | \"s\" ;",
+            "b = 1 2.5 123456789012345678901234567890 ;",
+            "c = ( \"s\" ] ;"
+        };
+
+        auto directory = llvm::SmallString<128>();
+        REQUIRE(!llvm::sys::fs::createUniqueDirectory("dark-snapshots", directory));
+
+        auto lex_batch = [&](LexerMock& mock) {
+            auto sources = llvm::SmallVector<SourceBuffer*>();
+            for (auto text: texts) {
+                sources.push_back(&mock.load(text));
+            }
+            return Lexer::lex_batch(sources, mock.value_stores, mock.consumer, 4, directory);
+        };
+
+        auto cold = LexerMock();
+        auto expected = lex_batch(cold);
+        REQUIRE(llvm::sys::fs::exists(directory + "/" + TokenSnapshot::get_filename(*cold.sources[0])));
+        REQUIRE(!llvm::sys::fs::exists(directory + "/" + TokenSnapshot::get_filename(*cold.sources[2])));
+
+        auto warm = LexerMock();
+        auto actual = lex_batch(warm);
+        REQUIRE(actual.size() == expected.size());
+        for (auto i = std::size_t{}; i < actual.size(); ++i) {
+            REQUIRE(LexerMock::to_string(actual[i]) == LexerMock::to_string(expected[i]));
+        }
+        REQUIRE(warm.value_stores.strings().size() == cold.value_stores.strings().size());
+        REQUIRE(warm.value_stores.ints().size() == cold.value_stores.ints().size());
+        REQUIRE(warm.consumer.diagnostics.size() == cold.consumer.diagnostics.size());
+
+        llvm::sys::fs::remove_directories(directory);
+    }
+}
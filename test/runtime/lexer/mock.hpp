@@ -1,6 +1,7 @@
 #include "diagnostics/basic_diagnostic.hpp"
 #include "diagnostics/diagnostic_consumer.hpp"
 #include "diagnostics/dianostic_converter.hpp"
+#include "source/line_table.hpp"
 #include <llvm/ADT/SmallVector.h>
 #include <llvm/ADT/StringRef.h>
 #include <llvm/Support/raw_ostream.h>
@@ -68,24 +69,16 @@ struct FakeLocationConverter: dark::DiagnosticConverter<char const*> {
     llvm::StringRef line{};
     llvm::StringRef file{"test.cpp"};
 
-    mutable llvm::SmallVector<unsigned> line_offsets{0};
+    mutable dark::LineTable line_table{};
 
     void set_line(llvm::StringRef line) {
         this->line = line;
-        line_offsets.clear();
-        line_offsets.push_back(0);
-        for (unsigned i = 0; i < line.size(); ++i) {
-            if (line[i] == '\n') {
-                line_offsets.push_back(i + 1);
-            }
-        }
+        line_table = dark::LineTable(line);
     }
 
     std::pair<unsigned, unsigned> find_loc(char const* loc) const {
-        auto offset = static_cast<unsigned>(loc - line.data());
-        auto it = std::upper_bound(line_offsets.begin(), line_offsets.end(), offset);
-        auto line_number = static_cast<unsigned>(it - line_offsets.begin());
-        return {line_number, offset - line_offsets[line_number - 1]};
+        auto [line_number, column] = line_table.lookup(static_cast<dark::LineTable::offset_type>(loc - line.data()));
+        return {static_cast<unsigned>(line_number + 1), static_cast<unsigned>(column)};
     }
 
     auto convert_loc(char const* loc, context_fn_t context_fn) const -> dark::DiagnosticLocation override {
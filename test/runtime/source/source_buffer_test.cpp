@@ -0,0 +1,149 @@
+#include <catch2/catch_test_macros.hpp>
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/VirtualFileSystem.h>
+#include <llvm/Support/raw_ostream.h>
+#include <array>
+#include <string>
+#include <type_traits>
+#include "source/source_buffer.hpp"
+#include "../lexer/mock.hpp"
+
+using namespace dark;
+
+static auto is_zero_padded(SourceBuffer const& source) -> bool {
+    auto padded = source.get_padded_source();
+    if (padded.size() != source.get_source().size() + SourceBuffer::padding) return false;
+    return padded.drop_front(source.get_source().size()).find_first_not_of('\0') == llvm::StringRef::npos;
+}
+
+TEST_CASE("Source Buffer", "[source_buffer]") {
+    auto consumer = MockDiagnosticConsumer();
+
+    SECTION("In-memory file is copied into a padded buffer") {
+        auto fs = llvm::vfs::InMemoryFileSystem();
+        fs.addFile("test.dark", 0, llvm::MemoryBuffer::getMemBuffer("rule =:: a;"));
+
+        for (auto mode: { SourceBuffer::LoadMode::Mapped, SourceBuffer::LoadMode::Buffered }) {
+            auto source = SourceBuffer::make_from_file(fs, "test.dark", consumer, mode);
+            REQUIRE(source.has_value());
+            REQUIRE(source->get_source() == "rule =:: a;");
+            REQUIRE(!source->is_mapped());
+            REQUIRE(is_zero_padded(*source));
+        }
+    }
+
+    SECTION("Files on disk keep their padding in every mode") {
+        auto fs = llvm::vfs::getRealFileSystem();
+
+        // The second size is page-aligned, which forces the padded copy.
+        for (auto size: { 5zu * 4096zu + 100zu, 5zu * 4096zu }) {
+            auto path = llvm::SmallString<128>{};
+            auto fd = 0;
+            REQUIRE(!llvm::sys::fs::createTemporaryFile("dark-source", "dark", fd, path));
+            auto content = std::string(size, 'a');
+            {
+                auto os = llvm::raw_fd_ostream(fd, /*shouldClose=*/true);
+                os << content;
+            }
+
+            for (auto mode: { SourceBuffer::LoadMode::Mapped, SourceBuffer::LoadMode::Buffered }) {
+                auto source = SourceBuffer::make_from_file(*fs, path, consumer, mode);
+                REQUIRE(source.has_value());
+                REQUIRE(source->get_source() == content);
+                REQUIRE(is_zero_padded(*source));
+                if (mode == SourceBuffer::LoadMode::Buffered) {
+                    REQUIRE(!source->is_mapped());
+                }
+            }
+
+            llvm::sys::fs::remove(path);
+        }
+    }
+
+    SECTION("Encoding is classified at load") {
+        auto fs = llvm::vfs::InMemoryFileSystem();
+        fs.addFile("ascii.dark", 0, llvm::MemoryBuffer::getMemBuffer("rule =:: a;"));
+        fs.addFile("utf8.dark", 0, llvm::MemoryBuffer::getMemBuffer("rule =:: \"\u00e9\";"));
+        fs.addFile("invalid.dark", 0, llvm::MemoryBuffer::getMemBuffer("rule =:: \"\xff\";"));
+
+        auto ascii = SourceBuffer::make_from_file(fs, "ascii.dark", consumer);
+        REQUIRE(ascii.has_value());
+        REQUIRE(ascii->is_ascii());
+        REQUIRE(ascii->is_valid_utf8());
+
+        auto utf8 = SourceBuffer::make_from_file(fs, "utf8.dark", consumer);
+        REQUIRE(utf8.has_value());
+        REQUIRE(!utf8->is_ascii());
+        REQUIRE(utf8->is_valid_utf8());
+
+        auto invalid = SourceBuffer::make_from_file(fs, "invalid.dark", consumer);
+        REQUIRE(invalid.has_value());
+        REQUIRE(!invalid->is_ascii());
+        REQUIRE(!invalid->is_valid_utf8());
+    }
+
+    SECTION("Line table maps offsets to lines and columns") {
+        auto fs = llvm::vfs::InMemoryFileSystem();
+        // Long enough for the vectorized scan to see newlines in more than one block.
+        auto content = std::string("a\nbc\n\n") + std::string(40, 'x') + "\nyz";
+        fs.addFile("test.dark", 0, llvm::MemoryBuffer::getMemBufferCopy(content));
+
+        auto source = SourceBuffer::make_from_file(fs, "test.dark", consumer);
+        REQUIRE(source.has_value());
+        auto const& table = source->get_line_table();
+        REQUIRE(table.size() == 5);
+
+        auto loc = table.lookup(3);
+        REQUIRE(loc.line == 1);
+        REQUIRE(loc.column == 1);
+
+        loc = table.lookup(5);
+        REQUIRE(loc.line == 2);
+        REQUIRE(loc.column == 0);
+
+        loc = table.lookup(static_cast<LineTable::offset_type>(content.size() - 1));
+        REQUIRE(loc.line == 4);
+        REQUIRE(loc.column == 1);
+
+        // Going backwards must not be served from the cached line.
+        loc = table.lookup(0);
+        REQUIRE(loc.line == 0);
+        REQUIRE(loc.column == 0);
+
+        REQUIRE(table.get_line(source->get_source(), 1) == "bc");
+        REQUIRE(table.get_line(source->get_source(), 2).empty());
+        REQUIRE(table.get_line(source->get_source(), 4) == "yz");
+    }
+
+    SECTION("Offsets and ids share one width") {
+        using unsigned_type = std::make_unsigned_t<IdBase::inner_type>;
+        STATIC_REQUIRE(sizeof(IdBase) == sizeof(IdBase::inner_type));
+        STATIC_REQUIRE(std::is_same_v<decltype(IdBase().as_unsigned()), unsigned_type>);
+        STATIC_REQUIRE(std::is_same_v<LineTable::offset_type, unsigned_type>);
+    #ifdef DARK_WIDE_SOURCE_OFFSETS
+        STATIC_REQUIRE(sizeof(IdBase) == 8);
+
+        // Offsets past 2^32 must not be truncated on the way to a line and column.
+        auto const far = LineTable::offset_type{1} << 33;
+        auto const starts = std::array<LineTable::offset_type, 3>{ 0, 10, far };
+        auto const table = LineTable::from_line_starts(starts);
+
+        auto loc = table.lookup(far + 5);
+        REQUIRE(loc.line == 2);
+        REQUIRE(loc.column == 5);
+
+        loc = table.lookup(far - 1);
+        REQUIRE(loc.line == 1);
+        REQUIRE(loc.column == far - 11);
+
+        REQUIRE(IdBase(static_cast<IdBase::inner_type>(far)).as_unsigned() == far);
+    #else
+        STATIC_REQUIRE(sizeof(IdBase) == 4);
+    #endif
+    }
+
+    REQUIRE(consumer.empty());
+}
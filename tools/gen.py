@@ -26,6 +26,7 @@ def main() -> None:
     parser = argparse.ArgumentParser(description='Generate a file with the given name and content.')
     parser.add_argument('-i', '--input', type=str, help='Path to the file to be generated', required=False)
     parser.add_argument('-o', '--output', type=str, help='Content to be written to the file', required=False)
+    parser.add_argument('-f', '--force', action='store_true', help='Overwrite the output if it already exists')
     args = parser.parse_args()
     
     if not args.input:
@@ -38,7 +39,7 @@ def main() -> None:
     
     output_path = get_output_path(input_path, args.output)
 
-    if output_path.exists():
+    if output_path.exists() and not args.force:
         print(f'Error: {output_path} already exists.', file=sys.stderr)
         exit(1)
     
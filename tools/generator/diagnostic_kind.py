@@ -40,6 +40,7 @@ class DiagnosticKind:
             "UnknownBaseSpecifier",
             "UnknownEscapeSequence",
             "UnmatchedClosing",
+            "UnmatchedOpening",
             "UnrecognizedCharacters",
             "UnterminatedString",
             "WrongRealLiteralExponent",
@@ -0,0 +1,53 @@
+from dataclasses import dataclass
+from typing import List
+
+# Decimal exponents covered by the table. Below the smallest, every 64-bit
+# mantissa rounds to zero; above the largest, every non-zero one overflows.
+SMALLEST_POWER_OF_FIVE = -342
+LARGEST_POWER_OF_FIVE = 308
+
+def _bit_length(value: int) -> int:
+    return value.bit_length()
+
+# Normalizes `5^q` so its most significant bit is bit 127 of a 128-bit word.
+# Positive powers are truncated; negative ones are reciprocals rounded up, as
+# the Eisel-Lemire algorithm expects.
+def normalized_power_of_five(q: int) -> int:
+    if q >= 0:
+        power = 5 ** q
+        shift = _bit_length(power) - 128
+        return power >> shift if shift > 0 else power << -shift
+
+    power = 5 ** -q
+    z = _bit_length(power)
+    if q >= -27:
+        result = (1 << (z + 127)) // power + 1
+    else:
+        result = (1 << (2 * z + 128)) // power + 1
+    while result >= 1 << 128:
+        result >>= 1
+    return result
+
+@dataclass(frozen=True, slots=True)
+class PowerOfFiveTable:
+    name: str
+    smallest: int
+    largest: int
+
+    def write(self, ostream) -> None:
+        count = self.largest - self.smallest + 1
+        ostream.writeln('inline constexpr auto smallest_power_of_five = {};', self.smallest)
+        ostream.writeln('inline constexpr auto largest_power_of_five = {};', self.largest)
+        ostream.writeln('')
+        ostream.writeln('// `{}[2 * (q - smallest_power_of_five)]` is the high word of `5^q` and', self.name)
+        ostream.writeln('// the entry after it the low word.')
+        ostream.writeln('inline constexpr std::uint64_t {}[{}] = {{', self.name, 2 * count)
+        for q in range(self.smallest, self.largest + 1):
+            value = normalized_power_of_five(q)
+            high = value >> 64
+            low = value & ((1 << 64) - 1)
+            ostream.writeln('    0x{:016X}, 0x{:016X}, // 5^{}', high, low, q)
+        ostream.writeln('}};')
+
+def make_power_of_five_table() -> PowerOfFiveTable:
+    return PowerOfFiveTable('power_of_five_128', SMALLEST_POWER_OF_FIVE, LARGEST_POWER_OF_FIVE)
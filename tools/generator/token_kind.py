@@ -1,6 +1,7 @@
 from dataclasses import Field, dataclass
 from functools import cmp_to_key
-from typing import List, Optional
+import random
+from typing import List, Optional, Tuple
 
 @dataclass(frozen=True, slots=True, kw_only=True)
 class Token:
@@ -120,4 +121,51 @@ def make_ebnf_tokens_bag() -> TokensBag:
     return TokensBag(EBNF_TOKENS)
 
 def make_lang_tokens_bag() -> TokensBag:
-    return TokensBag(LANG_TOKENS)
\ No newline at end of file
+    return TokensBag(LANG_TOKENS)
+
+MASK_64 = (1 << 64) - 1
+
+def keyword_hash_key(spelling: str) -> int:
+    """Must match `detail::keyword_hash_key` in token_kind.hpp."""
+    data = spelling.encode('utf-8')
+    size = len(data)
+    return (size & 0xFF) \
+        | data[0] << 8 \
+        | data[min(1, size - 1)] << 16 \
+        | data[size - 1] << 24 \
+        | data[max(size - 2, 0)] << 32
+
+def keyword_hash_slot(key: int, seed: int, bits: int) -> int:
+    if bits == 0:
+        return 0
+    return ((key * seed) & MASK_64) >> (64 - bits)
+
+@dataclass(frozen=True, slots=True)
+class KeywordHash:
+    seed: int
+    bits: int
+    slots: List[Tuple[int, str]] # (slot, kind)
+
+def make_keyword_hash(kinds: List[str], spellings: List[str], max_attempts: int = 100_000) -> KeywordHash:
+    """Searches for a multiplicative hash that maps every keyword to its own slot."""
+    keys = [keyword_hash_key(spelling) for spelling in spellings]
+    if len(set(keys)) != len(keys):
+        raise ValueError('Keywords with the same length, first and last two bytes cannot be hashed apart')
+
+    if len(keys) <= 1:
+        return KeywordHash(seed=1, bits=0, slots=[(0, kind) for kind in kinds])
+
+    rng = random.Random(0)
+    # A random seed avoids every collision with probability about
+    # exp(-n^2 / 2m), so start at a table size where that is not hopeless. The
+    # table holds one byte per slot, so even a sparse one stays small.
+    n = len(keys)
+    min_bits = max((n - 1).bit_length(), (n * n // 20).bit_length())
+    for bits in range(min_bits, min_bits + 4):
+        for _ in range(max_attempts):
+            seed = rng.getrandbits(64) | 1
+            slots = [keyword_hash_slot(key, seed, bits) for key in keys]
+            if len(set(slots)) == len(slots):
+                return KeywordHash(seed=seed, bits=bits, slots=sorted(zip(slots, kinds)))
+
+    raise ValueError(f'Unable to find a perfect hash for {len(keys)} keywords')
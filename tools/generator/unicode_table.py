@@ -0,0 +1,98 @@
+import unicodedata
+from dataclasses import dataclass
+from typing import Callable, Iterable, List, Tuple
+
+# Every block covers 256 code points stored as four 64-bit words.
+BLOCK_SHIFT = 8
+BLOCK_SIZE = 1 << BLOCK_SHIFT
+WORDS_PER_BLOCK = BLOCK_SIZE // 64
+MAX_CODE_POINT = 0x10FFFF
+
+# Unicode math, symbol, arrow, dingbat, and line/box drawing characters.
+OPERATOR_HEAD_RANGES: List[Tuple[int, int]] = [
+    (0x00A1, 0x00A7), (0x00A9, 0x00A9), (0x00AB, 0x00AC), (0x00AE, 0x00AE),
+    (0x00B0, 0x00B1), (0x00B6, 0x00B6), (0x00BB, 0x00BB), (0x00BF, 0x00BF),
+    (0x00D7, 0x00D7), (0x00F7, 0x00F7), (0x2016, 0x2017), (0x2020, 0x2027),
+    (0x2030, 0x203E), (0x2041, 0x2053), (0x2055, 0x205E), (0x2190, 0x23FF),
+    (0x2500, 0x2775), (0x2794, 0x2BFF), (0x2E00, 0x2E7F), (0x3001, 0x3003),
+    (0x3008, 0x3030),
+]
+
+# Combining marks may continue an operator but never start one.
+OPERATOR_COMBINING_RANGES: List[Tuple[int, int]] = [
+    (0x0300, 0x036F), (0x1DC0, 0x1DFF), (0x20D0, 0x20FF), (0xFE00, 0xFE0F),
+    (0xFE20, 0xFE2F), (0xE0100, 0xE01EF),
+]
+
+OPERATOR_ASCII = '/=-+*%<>!&|^~.?'
+
+def _is_surrogate(c: int) -> bool:
+    return 0xD800 <= c <= 0xDFFF
+
+# Python implements identifiers with XID_Start/XID_Continue, so the tables
+# follow the Unicode version of the interpreter running the generator.
+def is_xid_start(c: int) -> bool:
+    return not _is_surrogate(c) and chr(c).isidentifier()
+
+def is_xid_continue(c: int) -> bool:
+    return not _is_surrogate(c) and ('a' + chr(c)).isidentifier()
+
+def _in_ranges(ranges: Iterable[Tuple[int, int]]) -> Callable[[int], bool]:
+    ranges = list(ranges)
+    return lambda c: any(lo <= c <= hi for lo, hi in ranges)
+
+def is_operator_head(c: int) -> bool:
+    return (c < 0x80 and chr(c) in OPERATOR_ASCII) or _in_ranges(OPERATOR_HEAD_RANGES)(c)
+
+def is_operator_continue(c: int) -> bool:
+    return is_operator_head(c) or _in_ranges(OPERATOR_COMBINING_RANGES)(c)
+
+@dataclass(frozen=True, slots=True)
+class TwoStageTable:
+    name: str
+    stage1: List[int]
+    blocks: List[Tuple[int, ...]]
+
+    @staticmethod
+    def build(name: str, predicate: Callable[[int], bool]) -> 'TwoStageTable':
+        last = max(c for c in range(MAX_CODE_POINT + 1) if predicate(c))
+        unique: dict = {}
+        stage1: List[int] = []
+        for block in range((last >> BLOCK_SHIFT) + 1):
+            words = []
+            for word in range(WORDS_PER_BLOCK):
+                base = (block << BLOCK_SHIFT) + word * 64
+                value = 0
+                for bit in range(64):
+                    if predicate(base + bit):
+                        value |= 1 << bit
+                words.append(value)
+            stage1.append(unique.setdefault(tuple(words), len(unique)))
+
+        if len(unique) > 256:
+            raise ValueError(f'{name}: {len(unique)} unique blocks do not fit in an 8-bit index')
+
+        return TwoStageTable(name, stage1, list(unique.keys()))
+
+    def write(self, ostream) -> None:
+        ostream.writeln('inline constexpr auto {} = UnicodeTable<{}, {}>{{', self.name, len(self.stage1), len(self.blocks))
+        ostream.writeln('    .stage1 = {{')
+        for i in range(0, len(self.stage1), 16):
+            ostream.writeln('        {},', ', '.join(f'{index:3}' for index in self.stage1[i:i + 16]))
+        ostream.writeln('    }},')
+        ostream.writeln('    .blocks = {{{{')
+        for words in self.blocks:
+            ostream.writeln('        {{ {} }},', ', '.join(f'0x{word:016X}' for word in words))
+        ostream.writeln('    }}}}')
+        ostream.writeln('}};')
+
+def make_unicode_tables() -> List[TwoStageTable]:
+    return [
+        TwoStageTable.build('xid_start_table', is_xid_start),
+        TwoStageTable.build('xid_continue_table', is_xid_continue),
+        TwoStageTable.build('operator_head_table', is_operator_head),
+        TwoStageTable.build('operator_continue_table', is_operator_continue),
+    ]
+
+def unicode_version() -> str:
+    return unicodedata.unidata_version